@@ -7,6 +7,8 @@ struct buf {
   struct buf *prev; // LRU cache list
   struct buf *next;
   struct buf *qnext; // disk queue
+  uchar *addr;       // data of an uncached swap request, else 0
+  uint nsect;        // and its sectors, see ideswap()
   uchar data[BSIZE];
 };
 #define B_VALID 0x2  // buffer has been read from disk
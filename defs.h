@@ -2,6 +2,10 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct page;
+struct pgpolicy;
+struct pgstats;
+struct pgtrace;
 struct pipe;
 struct proc;
 struct rtcdate;
@@ -12,7 +16,6 @@ struct superblock;
 
 struct proc* 	get_proc_by_pgdir(pde_t *pgdir);
 void			init_pages_metadata(struct proc *p);
-void 		    update_pages_access();
 extern uint current_free_pages;
 extern uint total_free_pages;
 
@@ -58,15 +61,14 @@ struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, char*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
-int		createSwapFile(struct proc* p);
-int		readFromSwapFile(struct proc * p, char* buffer, uint placeOnFile, uint size);
-int		writeToSwapFile(struct proc* p, char* buffer, uint placeOnFile, uint size);
-int		removeSwapFile(struct proc* p);
+void            swapread(char*, uint, uint);
+void            swapwrite(char*, uint, uint);
 
 // ide.c
 void            ideinit(void);
 void            ideintr(void);
 void            iderw(struct buf*);
+void            ideswap(uint, uint, char*, int);
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
@@ -76,6 +78,8 @@ void            ioapicinit(void);
 // kalloc.c
 char*           kalloc(void);
 void            kfree(char*);
+void            kref(char*);
+int             krefcount(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
 
@@ -105,6 +109,17 @@ void            mpinit(void);
 void            picenable(int);
 void            picinit(void);
 
+// pcache.c
+void            pcacheinit(void);
+void            pcacheinval(struct inode*);
+char*           pcacheread(struct inode*, uint, uint);
+int             pcacheshrink(void);
+
+// pgtrace.c
+void            pgtraceinit(void);
+void            pgtrace(struct proc*, void*, int);
+int             readtrace(int, struct pgtrace*, int);
+
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
@@ -119,6 +134,13 @@ int             fork(void);
 int             growproc(int);
 int             kill(int);
 struct cpu*     mycpu(void);
+int             setpglimits(int, int);
+int             setpolicy(int);
+int             getwss(int);
+int             getpgstats(int, struct pgstats*);
+int             reclaim_frame(void);
+void            suspend(void);
+void            kswapdinit(void);
 struct proc*    myproc();
 void            pinit(void);
 void            procdump(void);
@@ -176,6 +198,7 @@ void            timerinit(void);
 // trap.c
 void            idtinit(void);
 extern uint     ticks;
+extern uint     userticks;
 void            tvinit(void);
 extern struct spinlock tickslock;
 
@@ -186,6 +209,7 @@ void            uartputc(int);
 
 // vm.c
 void            seginit(void);
+void            swapinit(void);
 void            kvmalloc(void);
 pde_t*          setupkvm(void);
 char*           uva2ka(pde_t*, char*);
@@ -199,9 +223,39 @@ void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+int             copy_on_write(struct proc*, void*);
+int             demand_page(struct proc*, void*);
+int             fail_demand_page(struct proc*, void*);
+int             touch_pages(struct proc*, uint, uint);
+void            unpin_pages(struct proc*);
 int			 swap_in(void* virtual_address, struct proc* proc);
 void			update_process_pages_access(struct proc* p);
+struct pgpolicy* default_policy(void);
+int             set_page_policy(struct proc*, int);
+struct page*    page_at(struct proc*, int);
+int             grow_pages_metadata(int, struct proc*);
+void            free_pages_metadata(struct proc*);
+void            release_page_slots(struct proc*);
+struct proc*    pick_global_victim(void**);
+int             swap_out(void*, struct proc*);
+void*           find_page_to_swap(struct proc*);
+int             clean_page(void*, struct proc*);
+void            dup_swap_slot(int);
+void            free_swap_slot(int);
+int             shrink_swap_cache(void);
+int             swap_out_all(struct proc*);
+extern uint     majorfaults;
+void            reserve_frames(void);
+int             copy_pages_metadata(struct proc*, struct proc*);
+int             insert_page(void*, struct proc*);
+int             set_page_limits(struct proc*, int, int);
+
 
+// zswap.c
+void            zswapinit(void);
+void            zswapdrop(int);
+int             zswapload(char*, int);
+int             zswapstore(char*, int);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
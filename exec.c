@@ -6,6 +6,10 @@
 #include "defs.h"
 #include "x86.h"
 #include "elf.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
 
 int
 exec(char *path, char **argv)
@@ -14,8 +18,10 @@ exec(char *path, char **argv)
   int i, off;
   uint argc, sz, sp, ustack[3+MAXARG+1];
   struct elfhdr elf;
-  struct inode *ip;
+  struct inode *ip, *exe, *oldexe;
   struct proghdr ph;
+  struct vmseg seg[NSEG];
+  int nseg;
   pde_t *pgdir, *oldpgdir;
   struct proc *curproc = myproc();
   curproc->is_alocated= 1;
@@ -29,6 +35,7 @@ exec(char *path, char **argv)
   }
   ilock(ip);
   pgdir = 0;
+  exe = 0;
 
   // Check ELF header
   if(readi(ip, (char*)&elf, 0, sizeof(elf)) != sizeof(elf))
@@ -39,8 +46,10 @@ exec(char *path, char **argv)
   if((pgdir = setupkvm()) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Leave the program for demand_page() to read in as it is
+  // touched, loading only segments past the first NSEG.
   sz = 0;
+  nseg = 0;
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, (char*)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -50,15 +59,30 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
-    if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
-      goto bad;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
+    if(ph.off + ph.filesz < ph.off || ph.off + ph.filesz > ip->size)
+      goto bad;
+    if(nseg < NSEG){
+      if(ph.vaddr + ph.memsz >= KERNBASE)
+        goto bad;
+      seg[nseg].vaddr = ph.vaddr;
+      seg[nseg].off = ph.off;
+      seg[nseg].filesz = ph.filesz;
+      nseg++;
+      if(ph.vaddr + ph.memsz > sz)
+        sz = ph.vaddr + ph.memsz;
+      continue;
+    }
+    if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
+      goto bad;
     if(loaduvm(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz) < 0)
       goto bad;
   }
-  iunlockput(ip);
+  // Keep a reference for reading the segments.
+  iunlock(ip);
   end_op();
+  exe = ip;
   ip = 0;
 
   // Allocate two pages at the next page boundary.
@@ -100,17 +124,30 @@ exec(char *path, char **argv)
   curproc->sz = sz;
   curproc->tf->eip = elf.entry;  // main
   curproc->tf->esp = sp;
+  oldexe = curproc->exe;
+  curproc->exe = exe;
+  memmove(curproc->seg, seg, sizeof(seg));
+  curproc->nseg = nseg;
   
   #ifndef NONE
   if (curproc->pid > 2) {
-    removeSwapFile(curproc);
-    createSwapFile(curproc);
+    // Page the new image from scratch; pages past the swap
+    // limit stay resident.
+    init_pages_metadata(curproc);
+    for(uint a = 0; a < sz; a += PGSIZE)
+      if(uva2ka(pgdir, (char*)a) && insert_page((void*)a, curproc) < 0)
+        break;
   }
   #endif
   curproc->is_exec = 1;
   
   switchuvm(curproc);
   freevm(oldpgdir,0);
+  if(oldexe){
+    begin_op();
+    iput(oldexe);
+    end_op();
+  }
 
   return 0;
 
@@ -123,5 +160,10 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
+  if(exe){
+    begin_op();
+    iput(exe);
+    end_op();
+  }
   return -1;
 }
@@ -34,6 +34,28 @@ static struct buf *idequeue;
 static int havedisk1;
 static void idestart(struct buf*);
 
+// Requests for the uncached swap page transfers of ideswap(), which
+// take one page at a time. A request is at most 7 sectors, so a page
+// takes two.
+#define SWAPREQS  2
+static struct {
+  struct sleeplock lock;
+  struct buf req[SWAPREQS];
+} swapio;
+
+// Where the data of b is, and its size.
+static uchar*
+bdata(struct buf *b)
+{
+  return b->addr ? b->addr : b->data;
+}
+
+static int
+bsize(struct buf *b)
+{
+  return b->addr ? b->nsect*SECTOR_SIZE : BSIZE;
+}
+
 // Wait for IDE disk to become ready.
 static int
 idewait(int checkerr)
@@ -53,6 +75,7 @@ ideinit(void)
   int i;
 
   initlock(&idelock, "ide");
+  initsleeplock(&swapio.lock, "swapio");
   ioapicenable(IRQ_IDE, ncpu - 1);
   idewait(0);
 
@@ -75,25 +98,26 @@ idestart(struct buf *b)
 {
   if(b == 0)
     panic("idestart");
-  if(b->blockno >= FSSIZE)
+  if(b->blockno >= FSSIZE + SWAPSIZE)
     panic("incorrect blockno");
   int sector_per_block =  BSIZE/SECTOR_SIZE;
   int sector = b->blockno * sector_per_block;
-  int read_cmd = (sector_per_block == 1) ? IDE_CMD_READ :  IDE_CMD_RDMUL;
-  int write_cmd = (sector_per_block == 1) ? IDE_CMD_WRITE : IDE_CMD_WRMUL;
+  int nsect = bsize(b)/SECTOR_SIZE;
+  int read_cmd = (nsect == 1) ? IDE_CMD_READ :  IDE_CMD_RDMUL;
+  int write_cmd = (nsect == 1) ? IDE_CMD_WRITE : IDE_CMD_WRMUL;
 
-  if (sector_per_block > 7) panic("idestart");
+  if (nsect > 7) panic("idestart");
 
   idewait(0);
   outb(0x3f6, 0);  // generate interrupt
-  outb(0x1f2, sector_per_block);  // number of sectors
+  outb(0x1f2, nsect);  // number of sectors
   outb(0x1f3, sector & 0xff);
   outb(0x1f4, (sector >> 8) & 0xff);
   outb(0x1f5, (sector >> 16) & 0xff);
   outb(0x1f6, 0xe0 | ((b->dev&1)<<4) | ((sector>>24)&0x0f));
   if(b->flags & B_DIRTY){
     outb(0x1f7, write_cmd);
-    outsl(0x1f0, b->data, BSIZE/4);
+    outsl(0x1f0, bdata(b), bsize(b)/4);
   } else {
     outb(0x1f7, read_cmd);
   }
@@ -116,7 +140,7 @@ ideintr(void)
 
   // Read data if needed.
   if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
-    insl(0x1f0, b->data, BSIZE/4);
+    insl(0x1f0, bdata(b), bsize(b)/4);
 
   // Wake process waiting for this buf.
   b->flags |= B_VALID;
@@ -166,3 +190,38 @@ iderw(struct buf *b)
 
   release(&idelock);
 }
+
+// Read or write the page at mem from or to the PGSIZE/BSIZE blocks
+// of disk dev from blockno, straight from mem and without the buffer
+// cache, which swapped pages would only crowd. Both requests are
+// queued at once, so the second starts as soon as the first is done.
+void
+ideswap(uint dev, uint blockno, char *mem, int write)
+{
+  struct buf *b, **pp;
+  int n = PGSIZE/SWAPREQS;
+
+  if(dev != 0 && !havedisk1)
+    panic("ideswap: ide disk 1 not present");
+
+  acquiresleep(&swapio.lock);
+  acquire(&idelock);
+  for(b = swapio.req; b < &swapio.req[SWAPREQS]; b++){
+    b->dev = dev;
+    b->blockno = blockno + (b - swapio.req) * (n/BSIZE);
+    b->addr = (uchar*)mem + (b - swapio.req) * n;
+    b->nsect = n/SECTOR_SIZE;
+    b->flags = write ? B_DIRTY : 0;
+    b->qnext = 0;
+    for(pp=&idequeue; *pp; pp=&(*pp)->qnext)
+      ;
+    *pp = b;
+    if(idequeue == b)
+      idestart(b);
+  }
+  for(b = swapio.req; b < &swapio.req[SWAPREQS]; b++)
+    while((b->flags & (B_VALID|B_DIRTY)) != B_VALID)
+      sleep(b, &idelock);
+  release(&idelock);
+  releasesleep(&swapio.lock);
+}
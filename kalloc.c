@@ -21,6 +21,7 @@ struct {
   struct spinlock lock;
   int use_lock;
   struct run *freelist;
+  uchar ref[PHYSTOP/PGSIZE];  // users of each page, see kref()
 } kmem;
 
 // Initialization happens in two phases.
@@ -70,6 +71,19 @@ kfree(char *v)
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
 
+  // A shared page is freed by its last user.
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  if(kmem.ref[V2P(v) / PGSIZE] > 1){
+    kmem.ref[V2P(v) / PGSIZE]--;
+    if(kmem.use_lock)
+      release(&kmem.lock);
+    return;
+  }
+  kmem.ref[V2P(v) / PGSIZE] = 0;
+  if(kmem.use_lock)
+    release(&kmem.lock);
+
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
 
@@ -97,9 +111,31 @@ kalloc(void)
   if(r){
 	kmem.freelist = r->next;
 	current_free_pages--;
+	kmem.ref[V2P(r) / PGSIZE] = 1;
   }
   if(kmem.use_lock)
     release(&kmem.lock);
   return (char*)r;
 }
 
+// Add a user to the allocated page v, which kfree() then only
+// frees once every user freed it. Used to share pages between
+// processes after fork.
+void
+kref(char *v)
+{
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  if(kmem.ref[V2P(v) / PGSIZE] == 0 || kmem.ref[V2P(v) / PGSIZE] == 0xFF)
+    panic("kref");
+  kmem.ref[V2P(v) / PGSIZE]++;
+  if(kmem.use_lock)
+    release(&kmem.lock);
+}
+
+int
+krefcount(char *v)
+{
+  return kmem.ref[V2P(v) / PGSIZE];
+}
+
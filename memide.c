@@ -58,3 +58,22 @@ iderw(struct buf *b)
     memmove(b->data, p, BSIZE);
   b->flags |= B_VALID;
 }
+
+// Read or write the page at mem from or to the PGSIZE/BSIZE blocks
+// of the disk from blockno.
+void
+ideswap(uint dev, uint blockno, char *mem, int write)
+{
+  uchar *p;
+
+  if(dev != 1)
+    panic("ideswap: request not for disk 1");
+  if(blockno + PGSIZE/BSIZE > disksize)
+    panic("ideswap: block out of range");
+
+  p = memdisk + blockno*BSIZE;
+  if(write)
+    memmove(p, mem, PGSIZE);
+  else
+    memmove(mem, p, PGSIZE);
+}
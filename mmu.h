@@ -142,6 +142,14 @@ struct segdesc {
 #define PTE_PS          0x080   // Page Size
 #define PTE_MBZ         0x180   // Bits must be zero
 #define PTE_PG 0x200 
+#define PTE_COW         0x400   // Copy-on-write, writeable once copied
+
+// A paged out PTE (PTE_PG set, PTE_P clear) holds the swap file
+// slot of the page where a present PTE holds the physical address.
+#define PTE_SLOT(pte)   ((uint)(pte) >> PTXSHIFT)
+#define SLOT_PTE(slot)  ((uint)(slot) << PTXSHIFT)
+// The slot of a page that was all zeros, which is not kept in swap.
+#define ZERO_SLOT       0xFFFFF
 
 // Address in page table or page directory entry
 #define PTE_ADDR(pte)   ((uint)(pte) & ~0xFFF)
@@ -4,7 +4,8 @@
 #include "syscall.h"
 
 #define PGSIZE 4096
-#define MAX_PHYS_PAGES 16
+
+int max_phys_pages;  // resident limit, read with setpglimits()
 
 void
 system_pause(){
@@ -19,32 +20,32 @@ allocate_max_phys_pages(char** arr){
 	arr[0] = "0";
 	arr[1] = "1000";
 	arr[2] = "2000";
-	for (i = 3; i < MAX_PHYS_PAGES; ++i) {
+	for (i = 3; i < max_phys_pages; ++i) {
 		arr[i] = sbrk(PGSIZE);
 		printf(1, "Allocate new page %d (address: %x).\n", i, arr[i]);
 	}
-	printf(1, "All %d physical pages have been allocated.\n", MAX_PHYS_PAGES);
+	printf(1, "All %d physical pages have been allocated.\n", max_phys_pages);
 }
 
 
 void
 test(){
-    char *memory_data[MAX_PHYS_PAGES + 3];
+    char **memory_data = malloc((max_phys_pages + 3) * sizeof(char*));
  	system_pause();
    
     allocate_max_phys_pages(memory_data);
     system_pause();
  
-    printf(1, "Allocate page #%d\n", MAX_PHYS_PAGES);
-    memory_data[MAX_PHYS_PAGES] = sbrk(PGSIZE);
+    printf(1, "Allocate page #%d\n", max_phys_pages);
+    memory_data[max_phys_pages] = sbrk(PGSIZE);
     system_pause();
  
     printf(1, "Access page #%d (address %x)\n", 3, memory_data[3]);
     memory_data[3][1] = 'a';
     system_pause();
  
-    printf(1, "Allocate page #%d.\n", MAX_PHYS_PAGES+1);
-    memory_data[MAX_PHYS_PAGES + 1] = sbrk(PGSIZE);
+    printf(1, "Allocate page #%d.\n", max_phys_pages+1);
+    memory_data[max_phys_pages + 1] = sbrk(PGSIZE);
     system_pause();
  
     printf(1, "Access pages %d-%d.\n", 4, 11);
@@ -57,8 +58,8 @@ test(){
     memory_data[4][1] = 'c';
     system_pause();
  
-    printf(1, "Allocate page #%d.\n", MAX_PHYS_PAGES + 2);
-    memory_data[MAX_PHYS_PAGES + 2] = sbrk(PGSIZE);
+    printf(1, "Allocate page #%d.\n", max_phys_pages + 2);
+    memory_data[max_phys_pages + 2] = sbrk(PGSIZE);
     system_pause();
  
     printf(1, "Calling fork.\n");
@@ -103,6 +104,10 @@ main(int argc, char *argv[]){
 	#endif
 	
 	#ifndef NONE
+	if((max_phys_pages = setpglimits(0, 0)) < 14){
+		printf(1, "resident limit %d too small for this test\n", max_phys_pages);
+		exit();
+	}
 	test();
 	#else
 	testNONE();
@@ -11,4 +11,18 @@
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       1000  // size of file system in blocks
+#define SWAPSIZE     16384  // size of swap partition in blocks
+#define MINFREE      64  // free frames kept by global replacement
+#define LOWFREE     128  // free frames below which kswapd runs
+#define HIGHFREE    256  // free frames kswapd pages out up to
+#define NPCACHE     128  // executable pages cached for sharing
+#define PFFHIGH       4  // page faults per PFF_TICKS to grow the resident limit
+#define PFFLOW        0  // page faults per PFF_TICKS to shrink it
+#define PFFMIN        4  // least resident limit, also for setpglimits
+#define LOADTICKS   100  // timer ticks between two load control checks
+#define CLEANTICKS   10  // timer ticks between two kswapd write-aheads
+#define THRASHFAULTS 50  // least major faults per LOADTICKS for thrashing
+#define WSWINDOW      8  // agings a page stays in the working set after use
+#define NTRACE     4096  // page references kept for readtrace
+#define MAX_PHYS_PAGES 16  // default resident page limit
 
@@ -0,0 +1,176 @@
+// Page cache for executables.
+//
+// demand_page() reads program pages through here, so that processes
+// running the same binary share one frame per page instead of each
+// reading its own copy. The frames are mapped copy-on-write, so a
+// process that writes to one gets a private copy.
+//
+// Interface:
+// * pcacheread returns a frame holding a page of a file, with a
+//     reference for the caller, who must not write to it.
+// * pcacheinval drops the pages of a file that has changed.
+// * pcacheshrink frees the least recently used page that no
+//     process maps, for when memory runs low.
+//
+// The cache holds one reference to each of its frames, so a frame
+// is free once it has left the cache and all its mappings are gone.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+
+struct cpage {
+  uint dev;
+  uint inum;
+  uint off;     // file offset of the page
+  uint n;       // bytes read from the file, the rest is zero
+  char *mem;    // the frame, 0 if the entry is free
+  uint used;    // pcache.clock when last looked up
+};
+
+struct {
+  struct spinlock lock;
+  struct cpage page[NPCACHE];
+  uint clock;
+  uint gen;     // bumped by pcacheinval
+} pcache;
+
+void
+pcacheinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+}
+
+static struct cpage*
+lookup(struct inode *ip, uint off, uint n)
+{
+  struct cpage *c;
+
+  for(c = pcache.page; c < &pcache.page[NPCACHE]; c++)
+    if(c->mem && c->dev == ip->dev && c->inum == ip->inum &&
+       c->off == off && c->n == n)
+      return c;
+  return 0;
+}
+
+// Return a frame holding n bytes of ip from off, zero filled to
+// the end of the page. Returns 0 if there is no memory or ip could
+// not be read.
+char*
+pcacheread(struct inode *ip, uint off, uint n)
+{
+  struct cpage *c, *victim;
+  char *mem, *old;
+  uint gen;
+  int held, r;
+
+  acquire(&pcache.lock);
+  if((c = lookup(ip, off, n)) != 0){
+    c->used = ++pcache.clock;
+    mem = c->mem;
+    kref(mem);
+    release(&pcache.lock);
+    return mem;
+  }
+  gen = pcache.gen;
+  release(&pcache.lock);
+
+  reserve_frames();
+  if((mem = kalloc()) == 0)
+    return 0;
+  memset(mem, 0, PGSIZE);
+  // A read() of ip into a page of its own program faults with ip
+  // already locked by this process.
+  held = holdingsleep(&ip->lock);
+  if(!held)
+    ilock(ip);
+  r = readi(ip, mem, off, n);
+  if(!held)
+    iunlock(ip);
+  if(r != n){
+    kfree(mem);
+    return 0;
+  }
+
+  acquire(&pcache.lock);
+  if((c = lookup(ip, off, n)) != 0){
+    // Another process read it meanwhile.
+    old = mem;
+    mem = c->mem;
+    kref(mem);
+    release(&pcache.lock);
+    kfree(old);
+    return mem;
+  }
+  if(gen != pcache.gen){
+    // ip may have changed after it was read; do not share the copy.
+    release(&pcache.lock);
+    return mem;
+  }
+  victim = 0;
+  for(c = pcache.page; c < &pcache.page[NPCACHE]; c++){
+    if(c->mem == 0){
+      victim = c;
+      break;
+    }
+    if(krefcount(c->mem) == 1 && (victim == 0 || c->used < victim->used))
+      victim = c;
+  }
+  if(victim){
+    if(victim->mem)
+      kfree(victim->mem);
+    victim->dev = ip->dev;
+    victim->inum = ip->inum;
+    victim->off = off;
+    victim->n = n;
+    victim->mem = mem;
+    victim->used = ++pcache.clock;
+    kref(mem);
+  }
+  release(&pcache.lock);
+  return mem;
+}
+
+// Drop the cached pages of ip, whose contents have changed.
+// Processes mapping them keep the old contents.
+void
+pcacheinval(struct inode *ip)
+{
+  struct cpage *c;
+
+  acquire(&pcache.lock);
+  pcache.gen++;
+  for(c = pcache.page; c < &pcache.page[NPCACHE]; c++){
+    if(c->mem && c->dev == ip->dev && c->inum == ip->inum){
+      kfree(c->mem);
+      c->mem = 0;
+    }
+  }
+  release(&pcache.lock);
+}
+
+// Free the least recently used page that only the cache holds.
+// Returns -1 if there is none.
+int
+pcacheshrink(void)
+{
+  struct cpage *c, *victim;
+
+  acquire(&pcache.lock);
+  victim = 0;
+  for(c = pcache.page; c < &pcache.page[NPCACHE]; c++)
+    if(c->mem && krefcount(c->mem) == 1 &&
+       (victim == 0 || c->used < victim->used))
+      victim = c;
+  if(victim){
+    kfree(victim->mem);
+    victim->mem = 0;
+  }
+  release(&pcache.lock);
+  return victim ? 0 : -1;
+}
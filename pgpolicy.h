@@ -0,0 +1,8 @@
+// Page replacement policies, selected per process with setpolicy().
+#define PG_NFUA     1   // not frequently used, with aging
+#define PG_LAPA     2   // least accessed page, with aging
+#define PG_SCFIFO   3   // second chance FIFO
+#define PG_AQ       4   // advancing queue
+#define PG_NRU      5   // not recently used, by accessed and dirty bits
+#define PG_ARC      6   // adaptive replacement, with ghost lists
+#define NPGPOLICY   7   // one past the last policy number
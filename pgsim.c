@@ -0,0 +1,252 @@
+// Replay the page references of a command under the optimal policy
+// and the aging and queue policies, and print the swap-ins each
+// would take next to those the command took.
+//
+//   pgsim [-f frames] command [args...]
+//
+// Runs command, which may be setpolicy to pick the policy it really
+// runs with, then reads its trace with readtrace(). Only the last
+// NTRACE references of all processes are kept, so a long running
+// command is replayed from some point on.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "pgpolicy.h"
+#include "pgtrace.h"
+
+#define OPT         0
+#define MAXFRAMES   256
+#define NEVER       0x7FFFFFFF
+
+char *names[NPGPOLICY] = {
+[OPT]        "OPT",
+[PG_NFUA]    "NFUA",
+[PG_LAPA]    "LAPA",
+[PG_SCFIFO]  "SCFIFO",
+[PG_AQ]      "AQ",
+};
+
+int policies[] = { OPT, PG_NFUA, PG_LAPA, PG_SCFIFO, PG_AQ };
+
+struct frame {
+  uint page;
+  uint count;   // aging counter
+  int ref;      // referenced since the last aging
+  int next;     // index of the next reference, for OPT
+};
+
+struct pgtrace *trace;
+int ntrace;
+int *nextuse;   // index of the next reference to the same page
+int npages;     // distinct pages
+
+struct frame fr[MAXFRAMES];   // in queue order for SCFIFO and AQ
+int nfr;
+
+// Find the next reference to the page of each record. Returns -1
+// if out of memory.
+int
+find_next_uses(void)
+{
+  uint *page;
+  int *last;
+  int i, j;
+
+  page = malloc(ntrace * sizeof(*page));
+  last = malloc(ntrace * sizeof(*last));
+  nextuse = malloc(ntrace * sizeof(*nextuse));
+  if(page == 0 || last == 0 || nextuse == 0)
+    return -1;
+  npages = 0;
+  for(i = ntrace - 1; i >= 0; i--){
+    for(j = 0; j < npages && page[j] != trace[i].page; j++)
+      ;
+    if(j == npages){
+      page[npages++] = trace[i].page;
+      last[j] = NEVER;
+    }
+    nextuse[i] = last[j];
+    last[j] = i;
+  }
+  free(page);
+  free(last);
+  return 0;
+}
+
+int
+count_ones(uint n)
+{
+  int count = 0;
+
+  for(; n > 0; n >>= 1)
+    count += n & 1;
+  return count;
+}
+
+int
+find(uint page)
+{
+  int i;
+
+  for(i = 0; i < nfr; i++)
+    if(fr[i].page == page)
+      return i;
+  return -1;
+}
+
+void
+age(int policy)
+{
+  struct frame f;
+  int i;
+
+  if(policy == PG_AQ){
+    for(i = 0; i < nfr - 1; i++){
+      if(!fr[i].ref && fr[i+1].ref){
+        f = fr[i];
+        fr[i] = fr[i+1];
+        fr[i+1] = f;
+      }
+    }
+  }
+  for(i = 0; i < nfr; i++){
+    fr[i].count >>= 1;
+    if(fr[i].ref)
+      fr[i].count |= 0x80000000;
+    fr[i].ref = 0;
+  }
+}
+
+int
+victim(int policy)
+{
+  struct frame f;
+  int i, v;
+
+  v = 0;
+  switch(policy){
+  case OPT:
+    for(i = 1; i < nfr; i++)
+      if(fr[i].next > fr[v].next)
+        v = i;
+    break;
+  case PG_NFUA:
+    for(i = 1; i < nfr; i++)
+      if(fr[i].count < fr[v].count)
+        v = i;
+    break;
+  case PG_LAPA:
+    for(i = 1; i < nfr; i++){
+      if(count_ones(fr[i].count) < count_ones(fr[v].count) ||
+         (count_ones(fr[i].count) == count_ones(fr[v].count) &&
+          fr[i].count < fr[v].count))
+        v = i;
+    }
+    break;
+  case PG_SCFIFO:
+    while(fr[0].ref){
+      f = fr[0];
+      f.ref = 0;
+      memmove(fr, fr+1, (nfr-1) * sizeof(fr[0]));
+      fr[nfr-1] = f;
+    }
+    break;
+  case PG_AQ:
+    v = nfr - 1;
+    break;
+  }
+  return v;
+}
+
+// Return the page faults of the trace under policy with frames
+// physical pages. Aging is done whenever the tick changes.
+int
+simulate(int policy, int frames)
+{
+  int i, j, faults;
+
+  nfr = 0;
+  faults = 0;
+  for(i = 0; i < ntrace; i++){
+    if(i > 0 && trace[i].tick != trace[i-1].tick && policy != OPT)
+      age(policy);
+    if((j = find(trace[i].page)) < 0){
+      faults++;
+      if(nfr == frames){
+        j = victim(policy);
+        memmove(fr+j, fr+j+1, (nfr-j-1) * sizeof(fr[0]));
+        nfr--;
+      }
+      // AQ queues new pages in front, the others at the tail.
+      j = nfr++;
+      if(policy == PG_AQ){
+        memmove(fr+1, fr, j * sizeof(fr[0]));
+        j = 0;
+      }
+      fr[j].page = trace[i].page;
+      fr[j].count = policy == PG_LAPA ? 0xFFFFFFFF : 0;
+    }
+    fr[j].ref = 1;
+    fr[j].next = nextuse[i];
+  }
+  return faults;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, pid, frames, faults;
+
+  frames = MAX_PHYS_PAGES;
+  if(argc > 2 && strcmp(argv[1], "-f") == 0){
+    frames = atoi(argv[2]);
+    argv += 2;
+    argc -= 2;
+  }
+  if(argc < 2 || frames < 1 || frames > MAXFRAMES){
+    printf(2, "usage: pgsim [-f frames] command [args...]\n");
+    exit();
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf(2, "pgsim: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    exec(argv[1], argv+1);
+    printf(2, "pgsim: exec %s failed\n", argv[1]);
+    exit();
+  }
+  wait();
+
+  if((trace = malloc(NTRACE * sizeof(*trace))) == 0){
+    printf(2, "pgsim: out of memory\n");
+    exit();
+  }
+  if((ntrace = readtrace(pid, trace, NTRACE)) <= 0){
+    printf(2, "pgsim: no page references traced for pid %d\n", pid);
+    exit();
+  }
+  if(find_next_uses() < 0){
+    printf(2, "pgsim: out of memory\n");
+    exit();
+  }
+  faults = 0;
+  for(i = 0; i < ntrace; i++)
+    if(trace[i].kind == TR_SWAPIN)
+      faults++;
+
+  // The first reference to each page misses under every policy and
+  // was a first touch, not a swap in, in the run, so leave those out.
+  printf(1, "%d references to %d pages over %d ticks, %d frames\n",
+         ntrace, npages, trace[ntrace-1].tick - trace[0].tick + 1, frames);
+  printf(1, "swap-ins, not counting first references:\n");
+  printf(1, "run\t%d\n", faults);
+  for(i = 0; i < sizeof(policies)/sizeof(policies[0]); i++)
+    printf(1, "%s\t%d\n", names[policies[i]],
+           simulate(policies[i], frames) - npages);
+  exit();
+}
@@ -0,0 +1,16 @@
+// Paging counters of a process, read with getpgstats().
+struct pgstats {
+  int limit;            // resident page limit
+  int resident;         // pages in memory
+  int swapped;          // pages in swap
+  int faults;           // page faults
+  int minor_faults;     // swap faults on a frame still cached
+  int major_faults;     // swap faults that read the page
+  int swapouts;         // pages ever swapped out
+  int clean_evictions;  // swap outs that needed no write
+  int prefetched;       // pages swapped in by readahead
+  int prefetch_hits;    // of which were accessed
+  int ghost_hits;       // ARC faults on a page in a ghost list
+  int wss;              // working set size
+  int suspended;        // stopped by load control
+};
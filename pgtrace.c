@@ -0,0 +1,78 @@
+// Page reference trace.
+//
+// The kernel records the page faults of paged processes, and the
+// pages found accessed each time their pages age, in one ring of the
+// last NTRACE records for all processes. readtrace() copies out
+// those of one process, so that a user program can replay its
+// references under other replacement policies.
+//
+// References are only sampled once per aging, so pages used within
+// one aging interval show up in no particular order.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "pgtrace.h"
+
+struct {
+  struct spinlock lock;
+  struct pgtrace rec[NTRACE];
+  uint next;    // records ever written, rec[next % NTRACE] is next
+} trace;
+
+void
+pgtraceinit(void)
+{
+  initlock(&trace.lock, "pgtrace");
+}
+
+// Record a reference of kind to the page at va by p.
+void
+pgtrace(struct proc *p, void *va, int kind)
+{
+  struct pgtrace *r;
+
+  if(p->pid <= 2 || !p->is_alocated)
+    return;
+  acquire(&trace.lock);
+  r = &trace.rec[trace.next++ % NTRACE];
+  r->pid = p->pid;
+  r->page = PGROUNDDOWN((uint)va);
+  r->tick = ticks;
+  r->kind = kind;
+  release(&trace.lock);
+}
+
+// Copy the records of process pid still in the ring to buf, oldest
+// first, up to n of them. Returns the number copied. buf is user
+// memory, so each record is copied without the lock held, in case
+// writing it faults.
+int
+readtrace(int pid, struct pgtrace *buf, int n)
+{
+  struct pgtrace r;
+  uint i, end;
+  int m;
+
+  acquire(&trace.lock);
+  i = trace.next > NTRACE ? trace.next - NTRACE : 0;
+  end = trace.next;
+  release(&trace.lock);
+
+  for(m = 0; i < end && m < n; i++){
+    acquire(&trace.lock);
+    if(trace.next - i > NTRACE){
+      // Overwritten meanwhile.
+      release(&trace.lock);
+      continue;
+    }
+    r = trace.rec[i % NTRACE];
+    release(&trace.lock);
+    if(r.pid == pid)
+      buf[m++] = r;
+  }
+  return m;
+}
@@ -0,0 +1,11 @@
+// Page reference trace records, read with readtrace().
+#define TR_REF      1   // page found accessed when its pages aged
+#define TR_FAULT    2   // other page fault: first touch or copy-on-write
+#define TR_SWAPIN   3   // page fault that swapped the page in
+
+struct pgtrace {
+  int pid;
+  uint page;    // virtual address of the page
+  uint tick;    // ticks when recorded
+  int kind;     // TR_*
+};
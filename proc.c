@@ -6,6 +6,7 @@
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "pgstats.h"
 
 struct {
   struct spinlock lock;
@@ -31,15 +32,6 @@ pinit(void)
 }
 
 
-void
-update_pages_access(){
-  struct proc* p;
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if((p->state == RUNNING || p->state == RUNNABLE || p->state == SLEEPING ) && p->pid > 2)
-      update_process_pages_access(p);
-}
-
-
 struct proc*
 get_proc_by_pgdir(pde_t *pgdir){
   struct proc* p;
@@ -52,23 +44,35 @@ get_proc_by_pgdir(pde_t *pgdir){
 void
 init_pages_metadata(struct proc *p)
 {
+  release_page_slots(p);
+  p->page_head = 0;
+  p->age_ticks = 0;
+  p->pff_ticks = 0;
+  p->pff_faults = 0;
+  p->wss = 0;
   p->swapped_in_count = 0;
   p->swapped_out_count = 0;
   p->page_faults_count = 0;
   p->total_swapped_out_count = 0;
+  p->last_fault = 0;
+  p->fault_stride = 0;
+  p->prefetch_count = 0;
+  p->prefetch_hits = 0;
+  p->clean_evictions = 0;
+  p->minor_faults = 0;
+  p->major_faults = 0;
+  p->nghost[0] = p->nghost[1] = 0;
+  p->arc_target = 0;
+  p->ghost_hits = 0;
+  p->npinned = 0;
+  p->pin_extra = 0;
 
   int i;
-  for (i = 0; i < MAX_TOTAL_PAGES - MAX_PHYS_PAGES; ++i)
-    p->swapped_out[i] = 0;
-
-  for (i = 0; i < MAX_PHYS_PAGES; ++i){
-    p->swapped_in[i].virtual_address = (void*) -1;
-	#ifdef NFUA
-    p->swapped_in[i].access_count = 0;
-    #elif LAPA
-    p->swapped_in[i].access_count = 0xFFFFFFFF;
-    #endif
+  for (i = 0; i < p->max_phys_pages; ++i){
+    page_at(p, i)->virtual_address = (void*) -1;
+    p->policy->reset(page_at(p, i), p);
   }
+  memset(p->page_hash, 0xFF, PGSIZE);  // all chains empty (-1)
 }
 
 
@@ -116,8 +120,10 @@ myproc(void) {
 // If found, change state to EMBRYO and initialize
 // state required to run in the kernel.
 // Otherwise return 0.
+// A kernel thread (user == 0) gets pid 0, so that the pids of
+// init and the shell stay 1 and 2.
 static struct proc*
-allocproc(void)
+allocproc(int user)
 {
   struct proc *p;
   char *sp;
@@ -133,7 +139,9 @@ allocproc(void)
 
 found:
   p->state = EMBRYO;
-  p->pid = nextpid++;
+  p->pid = user ? nextpid++ : 0;
+  p->suspended = 0;
+  p->pgfrozen = 0;
 
   release(&ptable.lock);
 
@@ -157,11 +165,19 @@ found:
   p->context = (struct context*)sp;
   memset(p->context, 0, sizeof *p->context);
   p->context->eip = (uint)forkret;
+  p->policy = default_policy();
   
   if(p->pid > 2){
-    createSwapFile(p);
+    p->max_phys_pages = MAX_PHYS_PAGES;
+    p->max_swap_pages = MAX_SWAP_PAGES;
+    if(grow_pages_metadata(p->max_phys_pages, p) < 0){
+      free_pages_metadata(p);
+      kfree(p->kstack);
+      p->kstack = 0;
+      p->state = UNUSED;
+      return 0;
+    }
     init_pages_metadata(p);
-    p->swapped_out_count = 0;
   }
   
   return p;
@@ -175,7 +191,7 @@ userinit(void)
   struct proc *p;
   extern char _binary_initcode_start[], _binary_initcode_size[];
 
-  p = allocproc();
+  p = allocproc(1);
   
   initproc = p;
   if((p->pgdir = setupkvm()) == 0)
@@ -215,8 +231,11 @@ growproc(int n)
 
   sz = curproc->sz;
   if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    // Only reserve the addresses; demand_page() allocates each
+    // page when it is first touched.
+    if(sz + n >= KERNBASE || sz + n < sz)
       return -1;
+    sz += n;
   } else if(n < 0){
     if((sz = deallocuvm(curproc->pgdir, sz, sz + n,curproc)) == 0)
       return -1;
@@ -237,30 +256,26 @@ fork(void)
   struct proc *curproc = myproc();
 
   // Allocate process.
-  if((np = allocproc()) == 0){
+  if((np = allocproc(1)) == 0){
     return -1;
   }
 
   #ifndef NONE
     if (curproc->pid > 2) { 
 	  np->is_alocated = curproc->is_alocated;
-      memmove(np->swapped_in, curproc->swapped_in, sizeof(curproc->swapped_in));
-      np->swapped_in_count = curproc->swapped_in_count;
-      np->swapped_out_count = curproc->swapped_out_count;
-      memmove(np->swapped_out, curproc->swapped_out, sizeof(curproc->swapped_out));      
-      int offset = 0; 
-	  int len = 0;
-      char buffer[PGSIZE / 2] = { 0 };
-
-      while ((len = readFromSwapFile(curproc, buffer, offset, PGSIZE / 2)) != 0) {
-        writeToSwapFile(np, buffer, offset, len);
-        offset += len;
+      if(copy_pages_metadata(np, curproc) < 0){
+        free_pages_metadata(np);
+        kfree(np->kstack);
+        np->kstack = 0;
+        np->state = UNUSED;
+        return -1;
       }
     }
   #endif
   
   // Copy process state from proc.
   if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
+    free_pages_metadata(np);
     kfree(np->kstack);
     np->kstack = 0;
     np->state = UNUSED;
@@ -268,6 +283,7 @@ fork(void)
   }
   np->sz = curproc->sz;
   np->parent = curproc;
+  np->policy = curproc->policy;
   *np->tf = *curproc->tf;
 
   // Clear %eax so that fork returns 0 in the child.
@@ -277,6 +293,10 @@ fork(void)
     if(curproc->ofile[i])
       np->ofile[i] = filedup(curproc->ofile[i]);
   np->cwd = idup(curproc->cwd);
+  if(curproc->exe)
+    np->exe = idup(curproc->exe);
+  memmove(np->seg, curproc->seg, sizeof(np->seg));
+  np->nseg = curproc->nseg;
 
   safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
@@ -314,11 +334,12 @@ exit(void)
 
   begin_op();
   iput(curproc->cwd);
+  if(curproc->exe)
+    iput(curproc->exe);
   end_op();
   curproc->cwd = 0;
-  
-  if(curproc->pid > 2)
-    removeSwapFile(curproc);
+  curproc->exe = 0;
+  curproc->nseg = 0;
 
   #ifdef TRUE
     procdump();
@@ -373,11 +394,14 @@ wait(void)
         pid = p->pid;
         kfree(p->kstack);
         p->kstack = 0;
-        freevm(p->pgdir, p);
+        freevm(p->pgdir, 0);  // the metadata goes as a whole
+        free_pages_metadata(p);
         p->pid = 0;
         p->parent = 0;
         p->name[0] = 0;
         p->killed = 0;
+        p->suspended = 0;
+        p->pgfrozen = 0;
 		p->is_alocated = 0;
         p->is_exec  = 0;
         p->state = UNUSED;
@@ -419,7 +443,7 @@ scheduler(void)
     // Loop over process table looking for process to run.
     acquire(&ptable.lock);
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->state != RUNNABLE)
+      if(p->state != RUNNABLE || p->pgfrozen)
         continue;
 
       // Switch to chosen process.  It is the process's job
@@ -431,10 +455,6 @@ scheduler(void)
 
       swtch(&(c->scheduler), p->context);
       switchkvm();
-      
-      #ifndef NONE
-      update_pages_access();
-      #endif
 
       // Process is done running for now.
       // It should have changed its p->state before coming back.
@@ -497,6 +517,9 @@ forkret(void)
     first = 0;
     iinit(ROOTDEV);
     initlog(ROOTDEV);
+#ifndef NONE
+    kswapdinit();  // pages out to the swap partition iinit found
+#endif
   }
 
   // Return to "caller", actually trapret (see allocproc).
@@ -575,6 +598,7 @@ kill(int pid)
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
     if(p->pid == pid){
       p->killed = 1;
+      p->suspended = 0;  // so that it can exit
       // Wake process from sleep if necessary.
       if(p->state == SLEEPING)
         p->state = RUNNABLE;
@@ -586,6 +610,280 @@ kill(int pid)
   return -1;
 }
 
+// Set the resident and swap page limits of the current process
+// (see set_page_limits). Children inherit them on fork.
+// Returns the resident limit now in effect, so that
+// setpglimits(0, 0) reads it, or -1 on error.
+int
+setpglimits(int phys, int swap)
+{
+  struct proc *p = myproc();
+
+  if(set_page_limits(p, phys, swap) < 0)
+    return -1;
+  return p->max_phys_pages;
+}
+
+// Free a frame for global replacement, from the swap cache or page
+// cache if they hold one, else by paging out a page of any process.
+// Another process is kept off the CPUs meanwhile, so its pages do
+// not change under it. Returns -1 if nothing was freed.
+int
+reclaim_frame(void)
+{
+  struct proc *p, *curproc = myproc();
+  void *va;
+  int r;
+
+  if(shrink_swap_cache() == 0 || pcacheshrink() == 0)
+    return 0;
+  acquire(&ptable.lock);
+  if((p = pick_global_victim(&va)) != 0 && p != curproc)
+    p->pgfrozen = 1;
+  release(&ptable.lock);
+  if(p == 0)
+    return -1;
+  r = swap_out(va, p);
+  if(p != curproc){
+    acquire(&ptable.lock);
+    p->pgfrozen = 0;
+    release(&ptable.lock);
+  }
+  return r;
+}
+
+// Load control, every LOADTICKS ticks. The system thrashes when
+// processes fault pages in from swap more often than the CPUs get
+// to run user code. Then suspend the youngest process, taken to
+// be the least important, so that the rest fit in memory; once the
+// faults subside, resume the process that was suspended first.
+// This only marks the process, with the number of the suspension,
+// and the process stops itself in suspend().
+static void
+load_control(void)
+{
+  static uint faults0, userticks0, nsuspend;
+  struct proc *p, *victim;
+  uint faults, uticks;
+  int active;
+
+  faults = majorfaults - faults0;
+  uticks = userticks - userticks0;
+  faults0 = majorfaults;
+  userticks0 = userticks;
+
+  acquire(&ptable.lock);
+  if(faults < THRASHFAULTS || faults <= uticks){
+    victim = 0;
+    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+      if(p->state == UNUSED || p->state == ZOMBIE || !p->suspended)
+        continue;
+      if(victim == 0 || p->suspended < victim->suspended)
+        victim = p;
+    }
+    if(victim){
+      victim->suspended = 0;
+      wakeup1(&victim->suspended);
+    }
+    release(&ptable.lock);
+    return;
+  }
+
+  // Keep at least one process going.
+  victim = 0;
+  active = 0;
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->pid <= 2 || p->page_hash == 0 || p->suspended)
+      continue;
+    if(p->state != RUNNABLE && p->state != RUNNING && p->state != SLEEPING)
+      continue;
+    active++;
+    if(!p->killed && (victim == 0 || p->pid > victim->pid))
+      victim = p;
+  }
+  if(active >= 2 && victim)
+    victim->suspended = ++nsuspend;
+  release(&ptable.lock);
+}
+
+// Stop the current process, which load_control() suspended, on its
+// way back to user space. It may have been sleeping with a sleeplock
+// or a log reservation, which others would wait on; here it holds
+// none. Page all of it out and wait to be resumed or killed.
+void
+suspend(void)
+{
+  struct proc *p = myproc();
+
+  swap_out_all(p);
+  acquire(&ptable.lock);
+  while(p->suspended && !p->killed)
+    sleep(&p->suspended, &ptable.lock);
+  release(&ptable.lock);
+}
+
+// Write ahead the next victim of each process at its resident limit
+// and off the CPUs, so that its next fault past the limit finds it
+// clean and only has to read. The process is frozen meanwhile, as in
+// reclaim_frame().
+static void
+clean_victims(void)
+{
+  struct proc *p;
+
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    acquire(&ptable.lock);
+    if(p->pid <= 2 || p->page_hash == 0 || p->pgfrozen ||
+       (p->state != SLEEPING && p->state != RUNNABLE) ||
+       p->swapped_in_count < p->max_phys_pages){
+      release(&ptable.lock);
+      continue;
+    }
+    p->pgfrozen = 1;
+    release(&ptable.lock);
+    clean_page(find_page_to_swap(p), p);
+    acquire(&ptable.lock);
+    p->pgfrozen = 0;
+    release(&ptable.lock);
+  }
+}
+
+// The page-out daemon. Woken by the timer while fewer than LOWFREE
+// frames are free, it pages out cold pages of any process until
+// HIGHFREE are, so that allocations rarely have to. Every CLEANTICKS
+// ticks it writes ahead the next victims of processes at their
+// limit, for local replacement, and every LOADTICKS it runs
+// load_control().
+void
+kswapd(void)
+{
+  uint ticks0, nextclean, nextload;
+
+  // Still holding ptable.lock from scheduler, as in forkret.
+  release(&ptable.lock);
+
+  nextclean = nextload = 0;
+  for(;;){
+    acquire(&tickslock);
+    while(current_free_pages >= LOWFREE && ticks < nextclean && ticks < nextload)
+      sleep(&current_free_pages, &tickslock);
+    ticks0 = ticks;
+    release(&tickslock);
+
+    if(ticks0 >= nextclean){
+      nextclean = ticks0 - ticks0 % CLEANTICKS + CLEANTICKS;
+      clean_victims();
+    }
+
+    if(ticks0 >= nextload){
+      nextload = ticks0 - ticks0 % LOADTICKS + LOADTICKS;
+      load_control();
+    }
+
+    while(current_free_pages < HIGHFREE)
+      if(reclaim_frame() < 0)
+        break;
+
+    // Nothing left to page out; do not retry on every tick.
+    if(current_free_pages < LOWFREE){
+      acquire(&tickslock);
+      ticks0 = ticks;
+      while(ticks - ticks0 < 100)
+        sleep(&ticks, &tickslock);
+      release(&tickslock);
+    }
+  }
+}
+
+// Start kswapd, a kernel thread with no user memory.
+void
+kswapdinit(void)
+{
+  struct proc *p;
+
+  if((p = allocproc(0)) == 0)
+    panic("kswapdinit");
+  if((p->pgdir = setupkvm()) == 0)
+    panic("kswapdinit: out of memory?");
+  p->context->eip = (uint)kswapd;
+  safestrcpy(p->name, "kswapd", sizeof(p->name));
+
+  acquire(&ptable.lock);
+  p->state = RUNNABLE;
+  release(&ptable.lock);
+}
+
+// Return the working set size of process pid in pages, as last
+// estimated on a timer tick that it ran, or -1 if there is no such
+// process.
+int
+getwss(int pid)
+{
+  struct proc *p;
+  int n;
+
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->pid == pid && p->state != UNUSED){
+      n = p->wss;
+      release(&ptable.lock);
+      return n;
+    }
+  }
+  release(&ptable.lock);
+  return -1;
+}
+
+// Copy the paging counters of process pid to st, user memory that
+// is written after ptable.lock is released. Returns -1 if there is
+// no such process or it is not paged.
+int
+getpgstats(int pid, struct pgstats *st)
+{
+  struct proc *p;
+  struct pgstats s;
+
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p->pid == pid && p->state != UNUSED)
+      break;
+  if(p == &ptable.proc[NPROC] || p->page_hash == 0){
+    release(&ptable.lock);
+    return -1;
+  }
+  s.limit = p->max_phys_pages;
+  s.resident = p->swapped_in_count;
+  s.swapped = p->swapped_out_count;
+  s.faults = p->page_faults_count;
+  s.minor_faults = p->minor_faults;
+  s.major_faults = p->major_faults;
+  s.swapouts = p->total_swapped_out_count;
+  s.clean_evictions = p->clean_evictions;
+  s.prefetched = p->prefetch_count;
+  s.prefetch_hits = p->prefetch_hits;
+  s.ghost_hits = p->ghost_hits;
+  s.wss = p->wss;
+  s.suspended = p->suspended != 0;
+  release(&ptable.lock);
+  *st = s;
+  return 0;
+}
+
+// Switch the current process to page replacement policy
+// number policy (see pgpolicy.h). The policy is kept across
+// exec and inherited by children.
+// Returns the previous policy number, or -1 on error.
+int
+setpolicy(int policy)
+{
+  int old;
+
+  acquire(&ptable.lock);
+  old = set_page_policy(myproc(), policy);
+  release(&ptable.lock);
+  return old;
+}
+
 //PAGEBREAK: 36
 // Print a process listing to console.  For debugging.
 // Runs when user types ^P on console.
@@ -613,9 +911,15 @@ procdump(void)
       state = states[p->state];
     else
       state = "???";
-    cprintf("PID: %d STATE: %s NAME: %s\n", p->pid, state, p->name);
+    cprintf("PID: %d STATE: %s NAME: %s POLICY: %s\n", p->pid, state, p->name, p->policy->name);
 	cprintf("ALLOCATED MEMORY PAGES: %d \nPAGED OUT: %d \nPAGE FAULTS: %d \nTOTAL PAGED OUT: %d\n",
 		p->swapped_in_count + p->swapped_out_count, p->swapped_out_count, p->page_faults_count, p->total_swapped_out_count);
+	cprintf("PREFETCHED: %d \nPREFETCH HITS: %d\nCLEAN EVICTIONS: %d\n", p->prefetch_count, p->prefetch_hits, p->clean_evictions);
+	cprintf("MINOR FAULTS: %d \nMAJOR FAULTS: %d\n", p->minor_faults, p->major_faults);
+	cprintf("RESIDENT LIMIT: %d \nWORKING SET: %d\n", p->max_phys_pages, p->wss);
+	cprintf("GHOST HITS: %d\n", p->ghost_hits);
+    if(p->suspended)
+      cprintf("SUSPENDED BY LOAD CONTROL\n");
 		
     if(p->state == SLEEPING){
       getcallerpcs((uint*)p->context->ebp+2, pc);
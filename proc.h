@@ -1,10 +1,40 @@
-#define MAX_PHYS_PAGES 16
-#define MAX_TOTAL_PAGES 32
+#define MAX_SWAP_PAGES (SWAPSIZE / 8)  // pages in the swap partition
+#define NPAGECHUNK 16        // pages of resident page metadata
 
 struct page
 {
 	void* virtual_address;
 	uint access_count;
+	int next;                    // next index in the same page_hash chain
+	int flags;                   // PAGE_* below
+	int slot;                    // swap slot with a copy of the page, or -1
+	uint history;                // a bit for each recent aging it was used in
+};
+
+#define PAGE_PREFETCHED 0x1      // swapped in ahead, not yet accessed
+#define PAGE_BUSY       0x2      // being written out by its owner
+#define PAGE_FILE       0x4      // read from the executable, see demand_page()
+#define PAGE_PINNED     0x8      // in use by a system call, see touch_pages()
+#define PAGE_REF        0x10     // accessed, for the clock hand, see age_refs()
+
+// The ARC list of a page, kept in access_count; see handle_ARC().
+#define ARC_T1          0
+#define ARC_T2          1
+#define NGHOST          (PGSIZE / sizeof(void*))  // most pages per ghost list
+
+#define PAGES_PER_CHUNK (PGSIZE / sizeof(struct page))
+#define MAX_RSS_PAGES   (NPAGECHUNK * PAGES_PER_CHUNK)  // resident limit
+#define NPAGEHASH       (PGSIZE / sizeof(int))          // page_hash size
+
+struct proc;
+
+// Page replacement policy, see pgpolicies[] in vm.c.
+struct pgpolicy {
+  char *name;
+  void* (*select)(struct proc*);  // pick the resident page to swap out
+  void (*reset)(struct page*, struct proc*);  // initialize a newly resident page
+  void (*age)(struct proc*);      // harvest PTE_A bits every AGE_TICKS
+  int ordered;                    // victims depend on queue order
 };
 
 // Per-CPU state
@@ -44,6 +74,15 @@ struct context {
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
+// A loadable part of the executable, read in a page at a time
+// as it is first touched instead of by exec().
+#define NSEG 4
+struct vmseg {
+  uint vaddr;                  // first address, page aligned
+  uint off;                    // file offset of vaddr
+  uint filesz;                 // bytes from the file, the rest is zero
+};
+
 struct proc {
   uint sz;                     // Size of process memory (bytes)
   pde_t* pgdir;                // Page table
@@ -58,17 +97,41 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  struct inode *exe;           // Executable the segments are read from
+  struct vmseg seg[NSEG];      // Parts of exe read on first touch
+  int nseg;
 
-  //Swap file. must initiate with create swap file
-  struct file *swapFile;      //page file
-  void* swapped_out[MAX_TOTAL_PAGES - MAX_PHYS_PAGES]; 
-  struct page swapped_in[MAX_PHYS_PAGES];
+  struct page *swapped_in[NPAGECHUNK]; // resident pages, see page_at()
+  int *page_hash;              // swapped_in chains, by virtual page
+  int page_head;               // swapped_in slot of queue position 0
+  int age_ticks;               // timer ticks since the pages were aged
+  int pff_ticks;               // timer ticks since the limit was adjusted
+  int pff_faults;              // page_faults_count at that adjustment
+  int wss;                     // working set size, see age_counters()
+  void **ghost[2];             // pages evicted from ARC's T1 and T2, a frame each
+  int nghost[2];
+  int arc_target;              // pages ARC aims to keep in T1
+  int ghost_hits;              // faults on a page still in a ghost list
+  int npinned;                 // resident pages with PAGE_PINNED
+  int pin_extra;               // pages touch_pages() added to the limit
+  int max_phys_pages;          // resident page limit
+  int max_swap_pages;          // swapped out page limit
   int swapped_out_count;
   int swapped_in_count;
   int page_faults_count;
   int total_swapped_out_count;
+  void *last_fault;            // page of the last swap in fault
+  int fault_stride;            // pages between the last two faults
+  int prefetch_count;          // pages swapped in by readahead
+  int prefetch_hits;           // of which were accessed
+  int clean_evictions;         // swap outs that needed no write
+  int minor_faults;            // swap faults on a frame still cached
+  int major_faults;            // swap faults that read the page
   int is_alocated;  
   int is_exec;
+  struct pgpolicy *policy;     // Page replacement policy
+  int pgfrozen;                // not to run, see reclaim_frame()
+  uint suspended;              // to stop in suspend(), see load_control()
 };
 
 // Process memory is laid out contiguously, low addresses first:
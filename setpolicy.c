@@ -0,0 +1,36 @@
+// Run a command under a given page replacement policy.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "pgpolicy.h"
+
+char *names[NPGPOLICY] = {
+[PG_NFUA]    "NFUA",
+[PG_LAPA]    "LAPA",
+[PG_SCFIFO]  "SCFIFO",
+[PG_AQ]      "AQ",
+[PG_NRU]     "NRU",
+[PG_ARC]     "ARC",
+};
+
+int
+main(int argc, char *argv[])
+{
+  int i;
+
+  if(argc < 3){
+    printf(2, "usage: setpolicy NFUA|LAPA|SCFIFO|AQ|NRU|ARC command [args...]\n");
+    exit();
+  }
+  for(i = 1; i < NPGPOLICY; i++)
+    if(names[i] && strcmp(argv[1], names[i]) == 0)
+      break;
+  if(i == NPGPOLICY || setpolicy(i) < 0){
+    printf(2, "setpolicy: unknown policy %s\n", argv[1]);
+    exit();
+  }
+  exec(argv[2], argv+2);
+  printf(2, "setpolicy: exec %s failed\n", argv[2]);
+  exit();
+}
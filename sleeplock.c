@@ -47,7 +47,7 @@ holdingsleep(struct sleeplock *lk)
   int r;
   
   acquire(&lk->lk);
-  r = lk->locked;
+  r = lk->locked && (lk->pid == myproc()->pid);
   release(&lk->lk);
   return r;
 }
@@ -65,6 +65,8 @@ argptr(int n, char **pp, int size)
     return -1;
   if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
     return -1;
+  if(touch_pages(curproc, i, size) < 0)
+    return -1;
   *pp = (char*)i;
   return 0;
 }
@@ -104,6 +106,11 @@ extern int sys_wait(void);
 extern int sys_write(void);
 extern int sys_uptime(void);
 extern int sys_yield(void);
+extern int sys_setpolicy(void);
+extern int sys_setpglimits(void);
+extern int sys_getwss(void);
+extern int sys_readtrace(void);
+extern int sys_getpgstats(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -128,6 +135,11 @@ static int (*syscalls[])(void) = {
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
 [SYS_yield]   sys_yield,
+[SYS_setpolicy] sys_setpolicy,
+[SYS_setpglimits] sys_setpglimits,
+[SYS_getwss]  sys_getwss,
+[SYS_readtrace] sys_readtrace,
+[SYS_getpgstats] sys_getpgstats,
 };
 
 void
@@ -139,6 +151,7 @@ syscall(void)
   num = curproc->tf->eax;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
     curproc->tf->eax = syscalls[num]();
+    unpin_pages(curproc);
   } else {
     cprintf("%d %s: unknown sys call %d\n",
             curproc->pid, curproc->name, num);
@@ -21,3 +21,8 @@
 #define SYS_mkdir  20
 #define SYS_close  21
 #define SYS_yield  22
+#define SYS_setpolicy 23
+#define SYS_setpglimits 24
+#define SYS_getwss 25
+#define SYS_readtrace 26
+#define SYS_getpgstats 27
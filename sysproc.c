@@ -6,6 +6,8 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "pgtrace.h"
+#include "pgstats.h"
 
 
 int sys_yield(void)
@@ -84,6 +86,26 @@ sys_sleep(void)
   return 0;
 }
 
+int
+sys_setpolicy(void)
+{
+  int policy;
+
+  if(argint(0, &policy) < 0)
+    return -1;
+  return setpolicy(policy);
+}
+
+int
+sys_setpglimits(void)
+{
+  int phys, swap;
+
+  if(argint(0, &phys) < 0 || argint(1, &swap) < 0)
+    return -1;
+  return setpglimits(phys, swap);
+}
+
 // return how many clock tick interrupts have occurred
 // since start.
 int
@@ -96,3 +118,36 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+int
+sys_getwss(void)
+{
+  int pid;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  return getwss(pid);
+}
+
+int
+sys_readtrace(void)
+{
+  int pid, n;
+  struct pgtrace *buf;
+
+  if(argint(0, &pid) < 0 || argint(2, &n) < 0 || n < 0 || n > NTRACE ||
+     argptr(1, (void*)&buf, n*sizeof(*buf)) < 0)
+    return -1;
+  return readtrace(pid, buf, n);
+}
+
+int
+sys_getpgstats(void)
+{
+  int pid;
+  struct pgstats *st;
+
+  if(argint(0, &pid) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+    return -1;
+  return getpgstats(pid, st);
+}
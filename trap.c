@@ -7,12 +7,14 @@
 #include "x86.h"
 #include "traps.h"
 #include "spinlock.h"
+#include "pgtrace.h"
 
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
 extern uint vectors[];  // in vectors.S: array of 256 entry pointers
 struct spinlock tickslock;
 uint ticks;
+uint userticks;  // timer interrupts of user code, on any CPU
 
 void
 tvinit(void)
@@ -56,8 +58,15 @@ trap(struct trapframe *tf)
       ticks++;
 	  
       wakeup(&ticks);
+#ifndef NONE
+      if(current_free_pages < LOWFREE || ticks % CLEANTICKS == 0 ||
+         ticks % LOADTICKS == 0)
+        wakeup(&current_free_pages);  // kswapd
+#endif
       release(&tickslock);
     }
+    if((tf->cs&3) == DPL_USER)
+      userticks++;
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
@@ -85,13 +94,24 @@ trap(struct trapframe *tf)
     page_fault_address = (void*)PGROUNDDOWN(rcr2());
 	struct proc* proc = myproc();
     entry = &proc->pgdir[PDX(page_fault_address)];
-    if (((int)(*entry) & PTE_P) != 0) {
+    if (((int)(*entry) & PTE_P) != 0 &&
+        swap_in((void*)PTE_ADDR(page_fault_address), proc) != 0) {
 	  //cprintf("\n trap.c PAGE FAULT OCCURED\n");
-      if (swap_in((void*)PTE_ADDR(page_fault_address), proc) != 0) {
-        proc->page_faults_count++;
-        return;
-      }
+      proc->page_faults_count++;
+      pgtrace(proc, page_fault_address, TR_SWAPIN);
+      return;
     }
+    pgtrace(proc, page_fault_address, TR_FAULT);
+    // Also taken by kernel writes to user memory, as CR0_WP is set.
+    if ((tf->err & FEC_WR) && ((int)(*entry) & PTE_P) != 0 &&
+        copy_on_write(proc, page_fault_address) == 0)
+      return;
+    if (demand_page(proc, page_fault_address))
+      return;
+    // The kernel touched a page that cannot be allocated; fail the
+    // process as a failed sbrk() would have.
+    if ((tf->cs&3) == 0 && fail_demand_page(proc, page_fault_address) == 0)
+      return;
   //PAGEBREAK: 13
   default:
     if(myproc() == 0 || (tf->cs&3) == 0){
@@ -114,6 +134,20 @@ trap(struct trapframe *tf)
   if(myproc() && myproc()->killed && (tf->cs&3) == DPL_USER)
     exit();
 
+  // Stop a process that load control suspended, now that it holds
+  // no locks.
+  if(myproc() && myproc()->suspended && (tf->cs&3) == DPL_USER)
+    suspend();
+
+#ifndef NONE
+  // Age the pages of the process that used up this tick and adjust
+  // its resident limit. Only from user mode, so no paging operation
+  // of it is half done.
+  if(myproc() && myproc()->state == RUNNING &&
+     tf->trapno == T_IRQ0+IRQ_TIMER && (tf->cs&3) == DPL_USER)
+    update_process_pages_access(myproc());
+#endif
+
   // Force process to give up CPU on clock tick.
   // If interrupts were on while locks held, would need to check nlock.
   if(myproc() && myproc()->state == RUNNING &&
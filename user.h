@@ -1,5 +1,7 @@
 struct stat;
 struct rtcdate;
+struct pgtrace;
+struct pgstats;
 
 // system calls
 int fork(void);
@@ -24,6 +26,11 @@ char* sbrk(int);
 int sleep(int);
 int uptime(void);
 int yield(void);
+int setpolicy(int);
+int setpglimits(int, int);
+int getwss(int);
+int readtrace(int, struct pgtrace*, int);
+int getpgstats(int, struct pgstats*);
 
 // ulib.c
 int stat(char*, struct stat*);
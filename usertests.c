@@ -7,6 +7,9 @@
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
+#include "pgpolicy.h"
+#include "pgtrace.h"
+#include "pgstats.h"
 
 char buf[8192];
 char name[3];
@@ -1737,6 +1740,776 @@ void argptest()
   printf(1, "arg test passed\n");
 }
 
+// Parent and child write the same copy-on-write page after fork,
+// the child also through read(); each must see only its own writes.
+void
+cowtest(void)
+{
+  int fds[2], pid;
+  char *p;
+
+  printf(1, "cow test\n");
+  p = sbrk(4096);
+  if(p == (char*)-1){
+    printf(1, "cow test sbrk failed\n");
+    exit();
+  }
+  p[0] = 'a';
+  if(pipe(fds) != 0){
+    printf(1, "cow test pipe failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(1, "cow test fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    close(fds[1]);
+    if(p[0] != 'a'){
+      printf(1, "cow test child sees %d\n", p[0]);
+      exit();
+    }
+    p[0] = 'c';
+    if(read(fds[0], p + 1, 1) != 1 || p[0] != 'c' || p[1] != 'x')
+      printf(1, "cow test child write lost\n");
+    exit();
+  }
+  close(fds[0]);
+  p[0] = 'p';
+  write(fds[1], "x", 1);
+  close(fds[1]);
+  wait();
+  if(p[0] != 'p' || p[1] != 0){
+    printf(1, "cow test parent sees child's write\n");
+    exit();
+  }
+  sbrk(-4096);
+  printf(1, "cow test ok\n");
+}
+
+// sbrk() memory is allocated on first touch, by the process or by
+// a system call writing to it. Past the swap limit, a touch by a
+// system call fails the call and one from user space kills the
+// process, instead of taking down the kernel.
+void
+lazysbrktest(void)
+{
+  int fds[2], i, n, pid, swap;
+  char *p;
+
+  printf(1, "lazy sbrk test\n");
+  p = sbrk(10*4096);
+  for(i = 0; i < 10; i++)
+    p[i*4096 + i] = i + 1;
+  for(i = 0; i < 10; i++){
+    if(p[i*4096 + i] != i + 1 || p[i*4096 + 100] != 0){
+      printf(1, "lazy sbrk test page %d wrong\n", i);
+      exit();
+    }
+  }
+  if(pipe(fds) != 0){
+    printf(1, "lazy sbrk test pipe failed\n");
+    exit();
+  }
+  // The kernel is the first to touch this page.
+  write(fds[1], "x", 1);
+  if(read(fds[0], p + 9*4096 + 4095, 1) != 1 || p[9*4096 + 4095] != 'x'){
+    printf(1, "lazy sbrk test read into new page failed\n");
+    exit();
+  }
+  sbrk(-10*4096);
+
+  pid = fork();
+  if(pid < 0){
+    printf(1, "lazy sbrk test fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    for(swap = 8; swap <= 4096 && setpglimits(0, swap) < 0; swap *= 2)
+      ;
+    if(swap > 4096)
+      exit();  // not paged
+    n = swap + 4096;
+    p = sbrk(n*4096);
+    for(i = 0; i < n; i++){
+      write(fds[1], "x", 1);
+      if(read(fds[0], p + i*4096, 1) != 1)
+        break;
+    }
+    if(i == n){
+      printf(1, "lazy sbrk test read past swap limit worked\n");
+      exit();
+    }
+    p[i*4096] = 1;
+    printf(1, "lazy sbrk test touch past swap limit worked\n");
+    exit();
+  }
+  wait();
+  close(fds[0]);
+  close(fds[1]);
+  printf(1, "lazy sbrk test ok\n");
+}
+
+// Programs are read from their file on first touch, and processes
+// running the same one share its pages. Run copies of echo at once,
+// each into its own file, and check what they wrote.
+void
+lazyexectest(void)
+{
+  char *args[] = { "echo", "lazy", "exec", 0 };
+  char file[] = "lazyexec0";
+  int fd, i, n, pid;
+
+  printf(1, "lazy exec test\n");
+  for(i = 0; i < 4; i++){
+    file[8] = '0' + i;
+    pid = fork();
+    if(pid < 0){
+      printf(1, "lazy exec test fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      close(1);
+      if(open(file, O_CREATE|O_WRONLY) != 1){
+        printf(2, "lazy exec test create failed\n");
+        exit();
+      }
+      exec("echo", args);
+      printf(2, "lazy exec test exec echo failed\n");
+      exit();
+    }
+  }
+  for(i = 0; i < 4; i++)
+    wait();
+  for(i = 0; i < 4; i++){
+    file[8] = '0' + i;
+    if((fd = open(file, O_RDONLY)) < 0){
+      printf(1, "lazy exec test open %s failed\n", file);
+      exit();
+    }
+    n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    unlink(file);
+    buf[n < 0 ? 0 : n] = 0;
+    if(strcmp(buf, "lazy exec\n") != 0){
+      printf(1, "lazy exec test %s has %s\n", file, buf);
+      exit();
+    }
+  }
+  printf(1, "lazy exec test ok\n");
+}
+
+// setpolicy() switches the replacement policy and returns the old.
+void
+setpolicytest(void)
+{
+  int old;
+
+  printf(1, "setpolicy test\n");
+  if(setpolicy(0) != -1 || setpolicy(NPGPOLICY) != -1){
+    printf(1, "setpolicy test took a bad policy\n");
+    exit();
+  }
+  old = setpolicy(PG_SCFIFO);
+  if(old <= 0 || old >= NPGPOLICY){
+    printf(1, "setpolicy test old policy %d\n", old);
+    exit();
+  }
+  if(setpolicy(old) != PG_SCFIFO){
+    printf(1, "setpolicy test did not switch\n");
+    exit();
+  }
+  printf(1, "setpolicy test ok\n");
+}
+
+// setpglimits() returns the resident limit in effect, leaves a
+// limit <= 0 alone and refuses a limit out of range. Run in a child,
+// which takes the limits with it.
+void
+pglimitstest(void)
+{
+  int phys, pid;
+
+  printf(1, "setpglimits test\n");
+  pid = fork();
+  if(pid < 0){
+    printf(1, "setpglimits test fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if((phys = setpglimits(0, 0)) < 0)
+      exit();  // not paged
+    if(setpglimits(1000000, 0) != -1 || setpglimits(0, 1000000) != -1 ||
+       setpglimits(1, 0) != -1)
+      printf(1, "setpglimits test took a bad limit\n");
+    else if(setpglimits(phys + 4, 0) != phys + 4 || setpglimits(0, 0) != phys + 4)
+      printf(1, "setpglimits test did not grow\n");
+    else if(setpglimits(phys, 0) != phys)
+      printf(1, "setpglimits test did not shrink\n");
+    exit();
+  }
+  wait();
+  printf(1, "setpglimits test ok\n");
+}
+
+// A system call can use more of the caller's memory than fits in
+// its resident limit: here a pipe copies a buffer four times the
+// limit under its lock, both ways, and the limit is back after.
+void
+pinpipetest(void)
+{
+  enum { NPG = 32, SZ = NPG*4096 };
+  int fds[2], i, n, pid;
+  char *p;
+
+  printf(1, "pin pipe test\n");
+  pid = fork();
+  if(pid < 0){
+    printf(1, "pin pipe test fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if(setpglimits(8, 0) != 8)
+      exit();  // not paged
+    p = sbrk(SZ);
+    for(i = 0; i < SZ; i++)
+      p[i] = i % 251;
+    if(pipe(fds) != 0){
+      printf(1, "pin pipe test pipe() failed\n");
+      exit();
+    }
+    pid = fork();
+    if(pid < 0){
+      printf(1, "pin pipe test fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      close(fds[0]);
+      if(write(fds[1], p, SZ) != SZ)
+        printf(1, "pin pipe test write failed\n");
+      exit();
+    }
+    close(fds[1]);
+    memset(p, 0, SZ);
+    for(i = 0; i < SZ; i += n)
+      if((n = read(fds[0], p + i, SZ - i)) <= 0)
+        break;
+    wait();
+    if(i != SZ){
+      printf(1, "pin pipe test read %d of %d\n", i, SZ);
+      exit();
+    }
+    for(i = 0; i < SZ; i++)
+      if(p[i] != (char)(i % 251)){
+        printf(1, "pin pipe test wrong data at %d\n", i);
+        exit();
+      }
+    if(setpglimits(0, 0) != 8)
+      printf(1, "pin pipe test limit not restored\n");
+    exit();
+  }
+  wait();
+  printf(1, "pin pipe test ok\n");
+}
+
+// Swap faults one page apart get the next pages swapped in ahead,
+// even at the resident limit, and a scan then uses them.
+void
+readaheadtest(void)
+{
+  enum { NPG = 64 };
+  struct pgstats st;
+  int i, pid;
+  char *p;
+
+  printf(1, "readahead test\n");
+  pid = fork();
+  if(pid < 0){
+    printf(1, "readahead test fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if(setpglimits(16, 0) != 16)
+      exit();  // not paged
+    p = sbrk(NPG*4096);
+    for(i = 0; i < NPG; i++)
+      p[i*4096] = i + 1;
+    for(i = 0; i < NPG; i++)
+      if(p[i*4096] != i + 1){
+        printf(1, "readahead test wrong data in page %d\n", i);
+        exit();
+      }
+    sbrk(-NPG*4096);
+    if(getpgstats(getpid(), &st) < 0){
+      printf(1, "readahead test getpgstats failed\n");
+      exit();
+    }
+    // With PFF or global replacement the limit may have grown.
+    if(READAHEAD > 0 && st.major_faults + st.minor_faults >= 4 &&
+       (st.prefetched == 0 || st.prefetch_hits == 0))
+      printf(1, "readahead test %d swap faults, %d prefetched, %d hits\n",
+             st.major_faults + st.minor_faults, st.prefetched, st.prefetch_hits);
+    exit();
+  }
+  wait();
+  printf(1, "readahead test ok\n");
+}
+
+// getwss() estimates the working set on the ticks a process runs:
+// pages kept in use count, it never exceeds the resident limit, and
+// pages left alone for WSWINDOW agings drop out, under every policy.
+void
+getwsstest(void)
+{
+  int i, old, phys, pol, start, wss;
+  volatile int spin;
+  char *p;
+
+  printf(1, "getwss test\n");
+  if(getwss(-1) != -1){
+    printf(1, "getwss test found pid -1\n");
+    exit();
+  }
+  if((phys = setpglimits(0, 0)) < 12){
+    printf(1, "getwss test ok\n");  // not paged, or too few pages
+    return;
+  }
+  p = sbrk(8*4096);
+  old = setpolicy(PG_NFUA);
+  for(pol = PG_NFUA; pol < NPGPOLICY; pol++){
+    setpolicy(pol);
+    start = uptime();
+    do {
+      for(i = 0; i < 8; i++)
+        p[i*4096]++;
+      wss = getwss(getpid());
+    } while(wss < 8 && uptime() < start + 50);
+    if(wss < 8 || wss > phys){
+      printf(1, "getwss test policy %d working set %d, limit %d\n", pol, wss, phys);
+      exit();
+    }
+    start = uptime();
+    do {
+      for(spin = 0; spin < 100000; spin++)
+        ;
+      wss = getwss(getpid());
+    } while(wss >= 8 && uptime() < start + 50 + 4*WSWINDOW*AGE_TICKS);
+    if(wss >= 8){
+      printf(1, "getwss test policy %d working set %d after idling\n", pol, wss);
+      exit();
+    }
+  }
+  setpolicy(old);
+  sbrk(-8*4096);
+  printf(1, "getwss test ok\n");
+}
+
+// readtrace() copies out the trace of one process, here the faults
+// on new pages, and refuses buffers that are not all the caller's,
+// also when their size overflows.
+void
+readtracetest(void)
+{
+  struct pgtrace *t = (struct pgtrace*)buf;
+  int i, n, pid;
+  char *p;
+
+  printf(1, "readtrace test\n");
+  pid = getpid();
+  if(readtrace(pid, t, -1) != -1 || readtrace(pid, t, NTRACE + 1) != -1 ||
+     readtrace(pid, t, 0x10000001) != -1 ||
+     readtrace(pid, (struct pgtrace*)0x7FFFF000, 1) != -1){
+    printf(1, "readtrace test took a bad buffer\n");
+    exit();
+  }
+  p = sbrk(4*4096);
+  for(i = 0; i < 4; i++)
+    p[i*4096] = 1;
+  sbrk(-4*4096);
+  n = readtrace(pid, t, sizeof(buf) / sizeof(*t));
+  if(n < 0 || (n == 0 && setpglimits(0, 0) >= 0)){
+    printf(1, "readtrace test read %d records\n", n);
+    exit();
+  }
+  for(i = 0; i < n; i++){
+    if(t[i].pid != pid){
+      printf(1, "readtrace test record of pid %d\n", t[i].pid);
+      exit();
+    }
+  }
+  printf(1, "readtrace test ok\n");
+}
+
+// Byte j of test page i: a few marks in zeros for even seeds, which
+// compresses, and hashed bytes for odd seeds, which does not.
+char
+pagebyte(int i, int j, uint seed)
+{
+  if(seed & 1)
+    return ((i*4096 + j) * 2654435761U + seed) >> 24;
+  return j % 512 == 0 ? i + seed + j/512 + 1 : 0;
+}
+
+// Fill the n pages at p with data that tells them apart.
+void
+fillpages(char *p, int n, uint seed)
+{
+  int i, j;
+
+  for(i = 0; i < n; i++)
+    for(j = 0; j < 4096; j++)
+      p[i*4096 + j] = pagebyte(i, j, seed);
+}
+
+// Return the first of the n pages at p that fillpages() did not
+// leave so, or -1 if there is none. Only reads them.
+int
+checkpages(char *p, int n, uint seed)
+{
+  int i, j;
+
+  for(i = 0; i < n; i++)
+    for(j = 0; j < 4096; j++)
+      if(p[i*4096 + j] != pagebyte(i, j, seed))
+        return i;
+  return -1;
+}
+
+// Pages swapped out come back with their data, under every policy:
+// a buffer twice the resident limit, written and then read back
+// twice, with a write to every other page in between.
+void
+swaptest(void)
+{
+  enum { NPG = 32 };
+  int bad, i, pid, pol;
+  char *p;
+
+  printf(1, "swap test\n");
+  for(pol = PG_NFUA; pol < NPGPOLICY; pol++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "swap test fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      if(setpolicy(pol) < 0 || setpglimits(16, 0) != 16)
+        exit();  // not paged
+      p = sbrk(NPG*4096);
+      fillpages(p, NPG, pol);
+      if((bad = checkpages(p, NPG, pol)) >= 0){
+        printf(1, "swap test policy %d wrong data in page %d\n", pol, bad);
+        exit();
+      }
+      for(i = 0; i < NPG; i += 2)
+        p[i*4096 + 1]++;
+      for(i = 0; i < NPG; i += 2)
+        p[i*4096 + 1]--;
+      if((bad = checkpages(p, NPG, pol)) >= 0)
+        printf(1, "swap test policy %d wrong data in page %d\n", pol, bad);
+      exit();
+    }
+    wait();
+  }
+  printf(1, "swap test ok\n");
+}
+
+// Pages come back from swap whether or not they compress, also to
+// a child that shares them and to its parent after the child wrote
+// its copies.
+void
+zswaptest(void)
+{
+  enum { NPG = 24 };
+  int bad, i, pid;
+  char *p, *q;
+
+  printf(1, "zswap test\n");
+  pid = fork();
+  if(pid < 0){
+    printf(1, "zswap test fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if(setpglimits(16, 0) != 16)
+      exit();  // not paged
+    p = sbrk(NPG*4096);
+    q = sbrk(NPG*4096);
+    fillpages(p, NPG, 4);
+    fillpages(q, NPG, 5);
+    pid = fork();
+    if(pid < 0){
+      printf(1, "zswap test fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      if((bad = checkpages(p, NPG, 4)) >= 0 || (bad = checkpages(q, NPG, 5)) >= 0)
+        printf(1, "zswap test child wrong data in page %d\n", bad);
+      for(i = 0; i < NPG; i++)
+        p[i*4096] = q[i*4096] = 0;
+      exit();
+    }
+    wait();
+    if((bad = checkpages(p, NPG, 4)) >= 0 || (bad = checkpages(q, NPG, 5)) >= 0)
+      printf(1, "zswap test wrong data in page %d\n", bad);
+    exit();
+  }
+  wait();
+  printf(1, "zswap test ok\n");
+}
+
+// A page that holds only zeros is dropped on swap out, as a clean
+// eviction without a slot, even after it was written, and comes
+// back zeroed.
+void
+zeropagetest(void)
+{
+  enum { NPG = 64 };
+  struct pgstats st0, st1;
+  int i, pid;
+  char *p;
+
+  printf(1, "zero page test\n");
+  pid = fork();
+  if(pid < 0){
+    printf(1, "zero page test fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if(setpglimits(16, 0) != 16)
+      exit();  // not paged
+    getpgstats(getpid(), &st0);
+    p = sbrk(NPG*4096);
+    for(i = 0; i < NPG; i++){
+      p[i*4096] = 1;
+      p[i*4096] = 0;
+    }
+    getpgstats(getpid(), &st1);
+    // At most 16 of the pages are still in.
+    if(st1.limit == 16 && st1.clean_evictions - st0.clean_evictions < NPG - 16)
+      printf(1, "zero page test %d of %d swap outs clean\n",
+             st1.clean_evictions - st0.clean_evictions, st1.swapouts - st0.swapouts);
+    for(i = 0; i < NPG*4096; i++)
+      if(p[i] != 0){
+        printf(1, "zero page test byte %d not zero\n", i);
+        exit();
+      }
+    exit();
+  }
+  wait();
+  printf(1, "zero page test ok\n");
+}
+
+// A fault on a page swapped out a moment ago finds its frame still
+// in the swap cache, a minor fault that reads nothing. Every page
+// out comes back by a minor or major fault, or by readahead.
+void
+minorfaulttest(void)
+{
+  enum { NPG = 64 };
+  struct pgstats st0, st1;
+  int bad, in, pid;
+  char *p;
+
+  printf(1, "minor fault test\n");
+  pid = fork();
+  if(pid < 0){
+    printf(1, "minor fault test fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if(setpglimits(16, 0) != 16)
+      exit();  // not paged
+    p = sbrk(NPG*4096);
+    fillpages(p, NPG, 6);
+    getpgstats(getpid(), &st0);
+    if((bad = checkpages(p, NPG, 6)) >= 0){
+      printf(1, "minor fault test wrong data in page %d\n", bad);
+      exit();
+    }
+    getpgstats(getpid(), &st1);
+    in = st1.minor_faults - st0.minor_faults + st1.major_faults - st0.major_faults +
+         st1.prefetched - st0.prefetched;
+    if(st1.limit == 16 && (st1.minor_faults == st0.minor_faults || in < NPG - 16))
+      printf(1, "minor fault test %d minor, %d major faults, %d prefetched\n",
+             st1.minor_faults - st0.minor_faults, st1.major_faults - st0.major_faults,
+             st1.prefetched - st0.prefetched);
+    exit();
+  }
+  wait();
+  printf(1, "minor fault test ok\n");
+}
+
+// With PFF_TICKS set, a process that faults often gets a higher
+// resident limit, and one that stops faulting a lower one again, but
+// not below PFFMIN.
+void
+pfftest(void)
+{
+  enum { NPG = 64 };
+  struct pgstats st;
+  int grown, i, pid, start;
+  volatile int spin;
+  char *p;
+
+  printf(1, "pff test\n");
+  if(PFF_TICKS == 0){
+    printf(1, "pff test ok\n");  // limits stay as set
+    return;
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(1, "pff test fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if(setpglimits(8, 0) != 8)
+      exit();  // not paged
+    p = sbrk(NPG*4096);
+    start = uptime();
+    do {
+      for(i = 0; i < NPG; i++)
+        p[i*4096]++;
+      getpgstats(getpid(), &st);
+    } while(st.limit <= 8 && uptime() < start + 50 + 10*PFF_TICKS);
+    if(st.limit <= 8){
+      printf(1, "pff test limit did not grow\n");
+      exit();
+    }
+    grown = st.limit;
+    start = uptime();
+    do {
+      for(spin = 0; spin < 100000; spin++)
+        ;
+      getpgstats(getpid(), &st);
+    } while(st.limit >= grown && uptime() < start + 50 + 10*PFF_TICKS);
+    if(st.limit >= grown || st.limit < PFFMIN)
+      printf(1, "pff test limit %d after idling, %d before\n", st.limit, grown);
+    exit();
+  }
+  wait();
+  printf(1, "pff test ok\n");
+}
+
+// Processes that page heavily at once all finish with their data,
+// whether or not load control suspends some of them meanwhile, and
+// one that pages until it is killed exits when it is.
+void
+loadtest(void)
+{
+  enum { NCHILD = 4, NPG = 32 };
+  int bad, i, n, pid;
+  char *p;
+
+  printf(1, "load control test\n");
+  for(i = 0; i <= NCHILD; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "load control test fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      if(setpglimits(8, 0) != 8 && i < NCHILD)
+        exit();  // not paged
+      p = sbrk(NPG*4096);
+      fillpages(p, NPG, 2*i);
+      for(n = 0; n < 4 || i == NCHILD; n++)
+        if((bad = checkpages(p, NPG, 2*i)) >= 0){
+          printf(1, "load control test wrong data in page %d\n", bad);
+          exit();
+        }
+      exit();
+    }
+  }
+  // The last child pages on until killed.
+  for(i = 0; i < NCHILD; i++)
+    wait();
+  kill(pid);
+  if(wait() != pid){
+    printf(1, "load control test killed child did not exit\n");
+    exit();
+  }
+  printf(1, "load control test ok\n");
+}
+
+// ARC remembers the pages it evicted last: faulting them back in,
+// newest first, counts ghost hits, and their data survives.
+void
+arctest(void)
+{
+  enum { NPG = 32 };
+  struct pgstats st;
+  int bad, i, pid;
+  char *p;
+
+  printf(1, "arc test\n");
+  pid = fork();
+  if(pid < 0){
+    printf(1, "arc test fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if(setpolicy(PG_ARC) < 0 || setpglimits(16, 0) != 16)
+      exit();  // not paged
+    p = sbrk(NPG*4096);
+    fillpages(p, NPG, 8);
+    for(i = NPG - 1; i >= 0; i--)
+      if(p[i*4096] != pagebyte(i, 0, 8)){
+        printf(1, "arc test wrong data in page %d\n", i);
+        exit();
+      }
+    getpgstats(getpid(), &st);
+    if(st.limit == 16 && st.ghost_hits == 0)
+      printf(1, "arc test no ghost hits\n");
+    if((bad = checkpages(p, NPG, 8)) >= 0)
+      printf(1, "arc test wrong data in page %d\n", bad);
+    exit();
+  }
+  wait();
+  printf(1, "arc test ok\n");
+}
+
+// A page swapped in and not written since goes out again without a
+// write: once a buffer four times the resident limit was read back,
+// reading it again evicts its pages clean, but for those that had
+// not been swapped out before.
+void
+cleantest(void)
+{
+  enum { NPG = 64 };
+  struct pgstats st0, st1;
+  int bad, pid;
+  char *p;
+
+  printf(1, "clean test\n");
+  pid = fork();
+  if(pid < 0){
+    printf(1, "clean test fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if(setpglimits(16, 0) != 16)
+      exit();  // not paged
+    p = sbrk(NPG*4096);
+    fillpages(p, NPG, 2);
+    checkpages(p, NPG, 2);
+    getpgstats(getpid(), &st0);
+    if((bad = checkpages(p, NPG, 2)) >= 0){
+      printf(1, "clean test wrong data in page %d\n", bad);
+      exit();
+    }
+    getpgstats(getpid(), &st1);
+    // With PFF or global replacement the limit may have grown.
+    if(st1.limit == 16 && st1.clean_evictions - st0.clean_evictions < NPG - 32)
+      printf(1, "clean test %d of %d swap outs clean\n",
+             st1.clean_evictions - st0.clean_evictions, st1.swapouts - st0.swapouts);
+    exit();
+  }
+  wait();
+  printf(1, "clean test ok\n");
+}
+
 unsigned long randstate = 1;
 unsigned int
 rand()
@@ -1780,6 +2553,22 @@ main(int argc, char *argv[])
   iputtest();
 
   mem();
+  setpolicytest();
+  pglimitstest();
+  pinpipetest();
+  readaheadtest();
+  getwsstest();
+  readtracetest();
+  swaptest();
+  cleantest();
+  zswaptest();
+  zeropagetest();
+  minorfaulttest();
+  pfftest();
+  loadtest();
+  arctest();
+  cowtest();
+  lazysbrktest();
   pipe1();
   preempt();
   exitwait();
@@ -1797,6 +2586,7 @@ main(int argc, char *argv[])
 
   uio();
 
+  lazyexectest();
   exectest();
 
   exit();
@@ -6,16 +6,29 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "pgpolicy.h"
+#include "pgtrace.h"
+#include "spinlock.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
+uint majorfaults;  // of all processes, for load control
 
-void swap_out(void* virtual_address, struct proc* proc);
+int swap_out(void* virtual_address, struct proc* proc);
 int findNextFreeIndex(void** arr, struct proc* proc);
 void* find_page_to_swap(struct proc* proc);
 int find_page_index(void* p, struct proc* proc);
-void insert_page(void* virtual_address, struct proc* proc);
+void unhash_page(int i, struct proc* proc);
+void remove_page(int i, struct proc* proc);
+int ring_slot(int pos, struct proc* proc);
+void dup_swap_slot(int slot);
+void free_swap_slot(int slot);
+int insert_page(void* virtual_address, struct proc* proc);
 void update_page(void *virtual_address, int physical_index, struct proc* proc);
+void check_prefetch(struct page* pg, pte_t* pte, struct proc* proc);
+void set_rmap(struct proc* proc, void* virtual_address);
+int grow_resident(struct proc* proc);
+extern struct pgpolicy pgpolicies[];
 
 // Set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
@@ -238,12 +251,7 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 
   a = PGROUNDUP(oldsz);
   for(; a < newsz; a += PGSIZE){
-	#ifndef NONE
-    if(proc->pid > 2 && proc->is_alocated) {
-      insert_page((void*)a, proc);
-    }
-    #endif
-	  
+    reserve_frames();
     mem = kalloc();
     if(mem == 0){
       cprintf("allocuvm out of memory\n");
@@ -257,18 +265,180 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
       kfree(mem);
       return 0;
     }
+	#ifndef NONE
+    // exec registers the pages of a new image once it commits.
+    if(proc->pid > 2 && proc->is_alocated && pgdir == proc->pgdir) {
+      if(insert_page((void*)a, proc) < 0){
+        cprintf("allocuvm out of swap space\n");
+        deallocuvm(pgdir, a + PGSIZE, oldsz, proc);
+        return 0;
+      }
+    }
+    #endif
   }
   return newsz;
 }
 
+// Find the part of page va that comes from proc's executable.
+// Returns its length and sets *off to its file offset, or returns
+// 0 if none of the page does.
+static uint
+exe_range(struct proc *proc, uint va, uint *off)
+{
+  struct vmseg *s;
+  uint n;
+
+  for(s = proc->seg; s < &proc->seg[proc->nseg]; s++){
+    if(va < s->vaddr || va >= s->vaddr + s->filesz)
+      continue;
+    n = s->vaddr + s->filesz - va;
+    *off = s->off + (va - s->vaddr);
+    return n < PGSIZE ? n : PGSIZE;
+  }
+  return 0;
+}
+
+// Map the page at va, which exec() or growproc() left for the
+// first touch to allocate: the executable's page from the page
+// cache, copy-on-write, if one of proc's segments covers it, a
+// zeroed page otherwise. Returns 0 if va is not such a page or
+// there is no memory for it.
+int
+demand_page(struct proc *proc, void *va)
+{
+  pte_t *pte;
+  char *mem;
+  uint n, off;
+  int perm;
+
+  va = (void*)PGROUNDDOWN((uint)va);
+  if((uint)va >= proc->sz)
+    return 0;
+  pte = walkpgdir(proc->pgdir, va, 0);
+  if(pte && (*pte & (PTE_P|PTE_PG)))
+    return 0;
+  if((n = exe_range(proc, (uint)va, &off)) > 0){
+    if((mem = pcacheread(proc->exe, off, n)) == 0)
+      return 0;
+    perm = PTE_COW|PTE_U;
+  } else {
+    reserve_frames();
+    if((mem = kalloc()) == 0)
+      return 0;
+    memset(mem, 0, PGSIZE);
+    perm = PTE_W|PTE_U;
+  }
+  if(mappages(proc->pgdir, va, PGSIZE, V2P(mem), perm) < 0){
+    kfree(mem);
+    return 0;
+  }
+#ifndef NONE
+  if(proc->pid > 2 && proc->is_alocated){
+    if(insert_page(va, proc) < 0){
+      deallocuvm(proc->pgdir, (uint)va + PGSIZE, (uint)va, proc);
+      return 0;
+    }
+    // Until written, swap_out() can drop it and this maps it again.
+    if(n > 0)
+      page_at(proc, find_page_index(va, proc))->flags |= PAGE_FILE;
+  }
+#endif
+  return 1;
+}
+
+// Bring in the pages of [va, va+n) that proc has swapped out or not
+// touched yet, before a system call uses them under a spinlock,
+// where a page fault must not sleep. They stay pinned until the
+// system call returns, see unpin_pages(); if they do not fit in
+// the resident limit besides a page to evict, it is raised until
+// then. Returns -1 if a page cannot be brought in.
+int
+touch_pages(struct proc *proc, uint va, uint n)
+{
+  pte_t *pte;
+  uint a;
+  int i, paged, need;
+
+  paged = 0;
+#ifndef NONE
+  paged = proc->pid > 2 && proc->is_alocated && proc->page_hash;
+#endif
+  if(paged){
+    need = proc->npinned + (PGROUNDUP(va + n) - PGROUNDDOWN(va)) / PGSIZE + 1;
+    if(need > proc->max_phys_pages){
+      need -= proc->max_phys_pages;
+      if(set_page_limits(proc, proc->max_phys_pages + need, 0) < 0)
+        return -1;
+      proc->pin_extra += need;
+    }
+  }
+  for(a = PGROUNDDOWN(va); a < va + n; a += PGSIZE){
+    pte = walkpgdir(proc->pgdir, (char*)a, 0);
+    if(pte && (*pte & PTE_PG)){
+      if(swap_in((void*)a, proc) == 0)
+        return -1;
+    } else if(!(pte && (*pte & PTE_P)) && demand_page(proc, (void*)a) == 0)
+      return -1;
+    if(paged && (i = find_page_index((void*)a, proc)) != -1 &&
+       !(page_at(proc, i)->flags & PAGE_PINNED)){
+      page_at(proc, i)->flags |= PAGE_PINNED;
+      proc->npinned++;
+    }
+  }
+  return 0;
+}
+
+// Let the replacement policies have the pages touch_pages() pinned
+// for the system call that just returned, and lower the resident
+// limit back.
+void
+unpin_pages(struct proc *proc)
+{
+  if(proc->npinned == 0 && proc->pin_extra == 0)
+    return;
+  for (int k = 0; k < proc->swapped_in_count; ++k)
+    page_at(proc, ring_slot(k, proc))->flags &= ~PAGE_PINNED;
+  proc->npinned = 0;
+  if(proc->pin_extra){
+    set_page_limits(proc, proc->max_phys_pages - proc->pin_extra, 0);
+    proc->pin_extra = 0;
+  }
+}
+
+// Mapped at a page the kernel touched first for a process that is
+// being killed because the page could not be allocated.
+static char scratch[PGSIZE] __attribute__((aligned(PGSIZE)));
+
+// Fail a kernel access to the untouched page at va of proc that
+// demand_page() could not allocate: kill proc, and map the scratch
+// page so that the access completes and the system call returns.
+// Returns -1 if va is not such a page.
+int
+fail_demand_page(struct proc *proc, void *va)
+{
+  pte_t *pte;
+
+  va = (void*)PGROUNDDOWN((uint)va);
+  if((uint)va >= proc->sz)
+    return -1;
+  pte = walkpgdir(proc->pgdir, va, 0);
+  if(pte && (*pte & (PTE_P|PTE_PG)))
+    return -1;
+  if(mappages(proc->pgdir, va, PGSIZE, V2P(scratch), PTE_W|PTE_U) < 0)
+    return -1;
+  proc->killed = 1;
+  return 0;
+}
 
 void
 deallocPageFromProc(struct proc* p, uint a){
   int physical_index = find_page_index((void*)PTE_ADDR(a), p);
   if(physical_index == -1) // if not found on proc arrays of pages
     return;
-  p->swapped_in_count--; 
-  p->swapped_in[physical_index].virtual_address = (void*) -1;
+  check_prefetch(page_at(p, physical_index), walkpgdir(p->pgdir, (void*)a, 0), p);
+  if(page_at(p, physical_index)->slot != -1)
+    free_swap_slot(page_at(p, physical_index)->slot);
+  remove_page(physical_index, p);
 }
 
 // Deallocate user pages to bring the process size from oldsz to
@@ -289,9 +459,16 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz, struct proc* np)
     pte = walkpgdir(pgdir, (char*)a, 0);
     if(!pte)
       a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+    else if((*pte & PTE_P) == 0 && (*pte & PTE_PG) != 0){
+      if(PTE_SLOT(*pte) != ZERO_SLOT)
+        free_swap_slot(PTE_SLOT(*pte));
+      if (np && np->pid >2 && np->is_alocated && pgdir == np->pgdir)
+        np->swapped_out_count--;
+      *pte = 0;
+    }
     else if((*pte & PTE_P) != 0){
 		#ifndef NONE
-      if (np && np->pid >2 && np->is_alocated ) {
+      if (np && np->pid >2 && np->is_alocated && pgdir == np->pgdir) {
           deallocPageFromProc(np, a);    
       }
     #endif
@@ -300,7 +477,8 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz, struct proc* np)
       if(pa == 0)
         panic("kfree");
       char *v = P2V(pa);
-      kfree(v);
+      if(v != scratch)
+        kfree(v);
       *pte = 0;
     }
   }
@@ -347,30 +525,36 @@ copyuvm(pde_t *pgdir, uint sz)
   pde_t *d;
   pte_t *pte;
   uint pa, i, flags;
-  char *mem;
 
   if((d = setupkvm()) == 0)
     return 0;
   for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
+    // Pages not yet touched since sbrk stay that way in the child.
+    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0 || (*pte & (PTE_P|PTE_PG)) == 0)
+      continue;
     if ((*pte & PTE_PG) != 0) {
-      mappages(d, (void*)i, PGSIZE, 0, PTE_FLAGS(*pte));
-      pte_t* pte = walkpgdir(d, (void*)i, 0);
-      *pte &= (~PTE_P);
+      // Share the swap slot; it is freed when the last entry
+      // holding it is swapped in or freed.
+      pte_t* npte = walkpgdir(d, (void*)i, 1);
+      if(npte == 0)
+        goto bad;
+      *npte = *pte;
+      if(PTE_SLOT(*pte) != ZERO_SLOT)
+        dup_swap_slot(PTE_SLOT(*pte));
       continue;
     }
   
-    if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
+    // Share the frame read-only; whichever side writes to it
+    // first gets its own copy, see copy_on_write().
+    if(*pte & PTE_W)
+      *pte = (*pte & ~PTE_W) | PTE_COW;
     pa = PTE_ADDR(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
-      goto bad;
-    memmove(mem, (char*)P2V(pa), PGSIZE);
-    if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0)
+    if(mappages(d, (void*)i, PGSIZE, pa, flags) < 0)
       goto bad;
+    kref(P2V(pa));
   }
+  lcr3(V2P(pgdir));  // pgdir, the current one, lost write access
   return d;
 
 bad:
@@ -378,15 +562,45 @@ bad:
   return 0;
 }
 
+// Give p a writeable page of its own at the copy-on-write page va,
+// copying the frame if it is still shared. Returns -1 if va is not
+// copy-on-write or there is no memory for the copy.
+int
+copy_on_write(struct proc *p, void *va)
+{
+  pde_t *pgdir = p->pgdir;
+  pte_t *pte;
+  char *mem, *old;
+
+  pte = walkpgdir(pgdir, va, 0);
+  if(pte == 0 || (*pte & (PTE_P|PTE_COW)) != (PTE_P|PTE_COW))
+    return -1;
+  old = P2V(PTE_ADDR(*pte));
+  if(krefcount(old) > 1){
+    if((mem = kalloc()) == 0)
+      return -1;
+    memmove(mem, old, PGSIZE);
+    *pte = V2P(mem) | PTE_FLAGS(*pte);
+    kfree(old);
+    if(p->page_hash && find_page_index((void*)PTE_ADDR(va), p) != -1)
+      set_rmap(p, va);
+  }
+  *pte = (*pte & ~PTE_COW) | PTE_W;
+  lcr3(V2P(pgdir));
+  return 0;
+}
+
 //PAGEBREAK!
-// Map user virtual address to kernel address.
+// Map user virtual address to kernel address. Returns 0 if uva is
+// not mapped, which lazily loaded images leave for whole page
+// tables.
 char*
 uva2ka(pde_t *pgdir, char *uva)
 {
   pte_t *pte;
 
   pte = walkpgdir(pgdir, uva, 0);
-  if((*pte & PTE_P) == 0)
+  if(pte == 0 || (*pte & PTE_P) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
@@ -427,86 +641,376 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
 // Blank page.
 
 
-void
-shift_physical_addresses_left(int start, struct proc* proc){
-  for (int i = start; i < MAX_PHYS_PAGES; ++i)
-    proc->swapped_in[i - 1] = proc->swapped_in[i];
+// Resident page metadata lives in page-sized chunks allocated
+// as the resident limit grows; page_at() finds entry i.
+struct page*
+page_at(struct proc* proc, int i){
+  return &proc->swapped_in[i / PAGES_PER_CHUNK][i % PAGES_PER_CHUNK];
 }
 
-void
-shift_physical_addresses_right(struct proc* proc){
-  for (int i = MAX_PHYS_PAGES - 1; i >0; i--)
-    proc->swapped_in[i] = proc->swapped_in[i-1];
+// Make room for n resident pages in the metadata of proc.
+// Returns -1 if out of memory.
+int
+grow_pages_metadata(int n, struct proc* proc){
+  if(proc->page_hash == 0){
+    if((proc->page_hash = (int*)kalloc()) == 0)
+      return -1;
+    memset(proc->page_hash, 0xFF, PGSIZE);  // all chains empty (-1)
+  }
+  for (int c = 0; c * PAGES_PER_CHUNK < n; ++c)
+  {
+    if(proc->swapped_in[c])
+      continue;
+    if((proc->swapped_in[c] = (struct page*)kalloc()) == 0)
+      return -1;
+    for (int i = 0; i < PAGES_PER_CHUNK; ++i)
+      proc->swapped_in[c][i].virtual_address = (void*) -1;
+  }
+  return 0;
 }
 
-int
-find_free_virtual_index(struct proc* proc){
-  for (int i = 0; i < MAX_TOTAL_PAGES - MAX_PHYS_PAGES; ++i)
+// Drop the swap slots that resident pages of proc still hold.
+void
+release_page_slots(struct proc* proc){
+  for (int i = 0; i < proc->max_phys_pages && proc->swapped_in[i / PAGES_PER_CHUNK]; ++i)
   {
-    if(proc->swapped_out[i] == 0){
-      return i;
+    struct page* pg = page_at(proc, i);
+    if(pg->virtual_address != (void*) -1 && pg->slot != -1){
+      free_swap_slot(pg->slot);
+      pg->slot = -1;
     }
   }
-  return -1;
 }
 
-int
-find_free_physical_index(struct proc* proc){
-  #ifndef AQ
-  for (int i = 0; i < MAX_PHYS_PAGES; ++i)
+void
+free_pages_metadata(struct proc* proc){
+  release_page_slots(proc);
+  for (int c = 0; c < NPAGECHUNK; ++c)
   {
-    if(proc->swapped_in[i].virtual_address == (void*) -1){
-      return i;
+    if(proc->swapped_in[c]){
+      kfree((char*)proc->swapped_in[c]);
+      proc->swapped_in[c] = 0;
     }
   }
-  panic("find_free_physical_index");
-  #endif
-  
-  #ifdef AQ
-  if(proc->swapped_in[MAX_PHYS_PAGES-1].virtual_address != (void*) -1){
-	  panic("find_free_physical_index");
+  if(proc->page_hash){
+    kfree((char*)proc->page_hash);
+    proc->page_hash = 0;
   }
-  shift_physical_addresses_right(proc);
+  for (int l = ARC_T1; l <= ARC_T2; ++l)
+  {
+    if(proc->ghost[l]){
+      kfree((char*)proc->ghost[l]);
+      proc->ghost[l] = 0;
+    }
+  }
+}
+
+// Give np a copy of the paging state of p, for fork.
+// Returns -1 if out of memory.
+int
+copy_pages_metadata(struct proc* np, struct proc* p){
+  if(grow_pages_metadata(p->max_phys_pages, np) < 0)
+    return -1;
+  for (int c = 0; c * PAGES_PER_CHUNK < p->max_phys_pages; ++c)
+    memmove(np->swapped_in[c], p->swapped_in[c], PGSIZE);
+  for (int i = 0; i < p->max_phys_pages; ++i)
+    if(page_at(np, i)->virtual_address != (void*) -1 && page_at(np, i)->slot != -1)
+      dup_swap_slot(page_at(np, i)->slot);
+  memmove(np->page_hash, p->page_hash, PGSIZE);
+  np->max_phys_pages = p->max_phys_pages;
+  np->max_swap_pages = p->max_swap_pages;
+  np->page_head = p->page_head;
+  np->swapped_in_count = p->swapped_in_count;
+  np->swapped_out_count = p->swapped_out_count;
   return 0;
-  #endif
 }
 
+// Resident pages are looked up through page_hash, a table of
+// swapped_in indices keyed by virtual page number and chained
+// through struct page.next.
+int
+hash_index(void* virtual_address){
+  return ((uint)virtual_address >> PGSHIFT) & (NPAGEHASH - 1);
+}
+
+void
+hash_page(int i, struct proc* proc){
+  int h = hash_index(page_at(proc, i)->virtual_address);
+  page_at(proc, i)->next = proc->page_hash[h];
+  proc->page_hash[h] = i;
+}
+
+void
+unhash_page(int i, struct proc* proc){
+  int* ip = &proc->page_hash[hash_index(page_at(proc, i)->virtual_address)];
+  while(*ip != i){
+    if(*ip == -1)
+      panic("unhash_page");
+    ip = &page_at(proc, *ip)->next;
+  }
+  *ip = page_at(proc, i)->next;
+}
+
+// Rebuild page_hash after pages moved inside swapped_in.
+void
+rehash_pages(struct proc* proc){
+  memset(proc->page_hash, 0xFF, PGSIZE);
+  for (int i = 0; i < proc->max_phys_pages; ++i)
+    if(page_at(proc, i)->virtual_address != (void*) -1)
+      hash_page(i, proc);
+}
+
+// The resident pages form a ring in swapped_in: queue position k
+// is slot (page_head + k) % max_phys_pages, and the first
+// swapped_in_count positions are in use. Position 0 is the head of
+// the FIFO queues, so they never shift the array to advance.
 int
-find_virtual_index(void* p, struct proc* proc){
-  for (int i = 0; i < MAX_TOTAL_PAGES - MAX_PHYS_PAGES; ++i)
+ring_slot(int pos, struct proc* proc){
+  return (proc->page_head + pos) % proc->max_phys_pages;
+}
+
+// Move the page in slot from to the empty slot to.
+void
+move_page(int from, int to, struct proc* proc){
+  unhash_page(from, proc);
+  *page_at(proc, to) = *page_at(proc, from);
+  page_at(proc, from)->virtual_address = (void*) -1;
+  hash_page(to, proc);
+}
+
+void
+swap_pages(int a, int b, struct proc* proc){
+  struct page temp;
+
+  unhash_page(a, proc);
+  unhash_page(b, proc);
+  temp = *page_at(proc, a);
+  *page_at(proc, a) = *page_at(proc, b);
+  *page_at(proc, b) = temp;
+  hash_page(a, proc);
+  hash_page(b, proc);
+}
+
+// Take the page in slot i out of the ring. Pages at either end
+// leave in O(1); a hole in the middle is filled by the tail page,
+// or, if the policy keeps the queue in order, by shifting the
+// pages behind it.
+void
+remove_page(int i, struct proc* proc){
+  int cap = proc->max_phys_pages;
+  int pos = (i - proc->page_head + cap) % cap;
+  int last = proc->swapped_in_count - 1;
+
+  unhash_page(i, proc);
+  page_at(proc, i)->virtual_address = (void*) -1;
+  proc->swapped_in_count--;
+  if(pos == last)
+    return;
+  if(pos == 0)
+    proc->page_head = ring_slot(1, proc);
+  else if(!proc->policy->ordered)
+    move_page(ring_slot(last, proc), i, proc);
+  else
+    for (; pos < last; ++pos)
+      move_page(ring_slot(pos + 1, proc), ring_slot(pos, proc), proc);
+}
+
+void
+reverse_pages(int lo, int hi, struct proc* proc){
+  struct page temp;
+
+  for (; lo < hi; lo++, hi--)
   {
-    if(proc->swapped_out[i] == p){
-      return i;
+    temp = *page_at(proc, lo);
+    *page_at(proc, lo) = *page_at(proc, hi);
+    *page_at(proc, hi) = temp;
+  }
+}
+
+// Rotate the ring so that it starts at slot 0, as needed before
+// max_phys_pages changes.
+void
+linearize_pages(struct proc* proc){
+  int h = proc->page_head;
+  int n = proc->max_phys_pages;
+
+  if(h == 0)
+    return;
+  reverse_pages(0, h - 1, proc);
+  reverse_pages(h, n - 1, proc);
+  reverse_pages(0, n - 1, proc);
+  proc->page_head = 0;
+  rehash_pages(proc);
+}
+
+// Slots of the swap partition, shared by all processes. A slot is
+// referenced by every page table entry that holds it, so a forked
+// child shares the swapped out pages of its parent.
+//
+// The frame a page was paged out of stays in frame[] until it is
+// needed for something else, so that a fault on the page soon after
+// maps it again without reading it back.
+struct {
+  struct spinlock lock;
+  uchar ref[MAX_SWAP_PAGES];
+  char *frame[MAX_SWAP_PAGES];
+  uint cached[MAX_SWAP_PAGES];  // clock when frame was cached
+  uint clock;
+} swapslots;
+
+void
+swapinit(void)
+{
+  initlock(&swapslots.lock, "swapslots");
+}
+
+// Allocate a swap slot for proc, lowest first. Returns -1 if proc
+// reached its swap limit or the swap partition is full.
+int
+alloc_swap_slot(struct proc* proc){
+  int slot = -1;
+
+  if(proc->swapped_out_count >= proc->max_swap_pages)
+    return -1;
+  acquire(&swapslots.lock);
+  for (int i = 0; i < MAX_SWAP_PAGES; ++i)
+  {
+    if(swapslots.ref[i] == 0){
+      swapslots.ref[i] = 1;
+      slot = i;
+      break;
     }
   }
-  return -1;
+  release(&swapslots.lock);
+  return slot;
+}
+
+void
+dup_swap_slot(int slot){
+  acquire(&swapslots.lock);
+  if(swapslots.ref[slot] == 0 || swapslots.ref[slot] == 0xFF)
+    panic("dup_swap_slot");
+  swapslots.ref[slot]++;
+  release(&swapslots.lock);
+}
+
+void
+free_swap_slot(int slot){
+  char *mem;
+
+  acquire(&swapslots.lock);
+  if(swapslots.ref[slot] == 0)
+    panic("free_swap_slot");
+  if(swapslots.ref[slot] == 1){
+    // Only the last user can drop the cached copy, and the slot is
+    // not free before that.
+    release(&swapslots.lock);
+    zswapdrop(slot);
+    acquire(&swapslots.lock);
+  }
+  swapslots.ref[slot]--;
+  mem = 0;
+  if(swapslots.ref[slot] == 0){
+    mem = swapslots.frame[slot];
+    swapslots.frame[slot] = 0;
+  }
+  release(&swapslots.lock);
+  if(mem)
+    kfree(mem);
+}
+
+// Keep mem, the frame of a page just paged out to slot, in the swap
+// cache in place of freeing it.
+static void
+cache_swap_frame(int slot, char *mem)
+{
+  char *old;
+
+  acquire(&swapslots.lock);
+  old = swapslots.frame[slot];
+  swapslots.frame[slot] = mem;
+  swapslots.cached[slot] = ++swapslots.clock;
+  release(&swapslots.lock);
+  if(old)
+    kfree(old);
+}
+
+// Take the frame cached for slot, or return 0 if there is none.
+static char*
+take_swap_frame(int slot)
+{
+  char *mem;
+
+  acquire(&swapslots.lock);
+  mem = swapslots.frame[slot];
+  swapslots.frame[slot] = 0;
+  release(&swapslots.lock);
+  return mem;
+}
+
+// Free the frame cached the longest. Returns -1 if there is none.
+int
+shrink_swap_cache(void)
+{
+  char *mem;
+  int i, old;
+
+  acquire(&swapslots.lock);
+  old = -1;
+  for(i = 0; i < MAX_SWAP_PAGES; i++)
+    if(swapslots.frame[i] &&
+       (old < 0 || swapslots.cached[i] < swapslots.cached[old]))
+      old = i;
+  if(old < 0){
+    release(&swapslots.lock);
+    return -1;
+  }
+  mem = swapslots.frame[old];
+  swapslots.frame[old] = 0;
+  release(&swapslots.lock);
+  kfree(mem);
+  return 0;
+}
+
+// Return the slot for a new page: the tail of the ring, or the
+// head for AQ, which queues new pages in front.
+int
+find_free_physical_index(struct proc* proc){
+  if(proc->swapped_in_count >= proc->max_phys_pages)
+    panic("find_free_physical_index");
+  if(proc->policy != &pgpolicies[PG_AQ])
+    return ring_slot(proc->swapped_in_count, proc);
+  proc->page_head = ring_slot(proc->max_phys_pages - 1, proc);
+  return proc->page_head;
 }
 
 int
 find_page_index(void* p, struct proc* proc){
-  for (int i = 0; i < MAX_PHYS_PAGES; ++i)
+  for (int i = proc->page_hash[hash_index(p)]; i != -1; i = page_at(proc, i)->next)
   {
-    if(proc->swapped_in[i].virtual_address == p){
+    if(page_at(proc, i)->virtual_address == p){
       return i;
     }
   }
   return -1;
 }
 
+// Pages pinned by touch_pages() are never victims; touch_pages()
+// leaves at least one resident page that is not.
 void*
 handle_NFUA(struct proc* proc){
-  int min_index = 0;
-  int min_accessed = proc->swapped_in[min_index].access_count;
-  for (int i = 0; i < MAX_PHYS_PAGES; ++i)
+  int min_index = -1;
+  for (int i = 0; i < proc->max_phys_pages; ++i)
   {
-    if(proc->swapped_in[i].access_count < min_accessed){
+    if(page_at(proc, i)->flags & PAGE_PINNED)
+      continue;
+    if(min_index == -1 || page_at(proc, i)->access_count < page_at(proc, min_index)->access_count){
       min_index = i;
-      min_accessed = proc->swapped_in[i].access_count;
     }
   }
   
   //cprintf("Address returned from handle_NFUA is: %x, at index %d\n ",virtual_address, min_index);
-  return proc->swapped_in[min_index].virtual_address;
+  return page_at(proc, min_index)->virtual_address;
 }
 
 int
@@ -521,77 +1025,359 @@ count_ones(uint n){
 
 void*
 handle_LAPA(struct proc* proc){
-  int ones_counts[MAX_PHYS_PAGES];
-  for (int i = 0; i < MAX_PHYS_PAGES; ++i){
-	  ones_counts[i] = count_ones(proc->swapped_in[i].access_count);
-    //cprintf("ones count %d: %d    access count: %d\n", i, ones_counts[i], proc->swapped_in[i].access_count);
-  }
-	  
-  int min_index = 0;
-  int current, min_ones = ones_counts[min_index];
-  for (int i = 0; i < MAX_PHYS_PAGES; i++)
+  int min_index = -1;
+  int current, min_ones = 33;  // more than any counter has
+  for (int i = 0; i < proc->max_phys_pages; i++)
   {
-	current = ones_counts[i];
+    if(page_at(proc, i)->flags & PAGE_PINNED)
+      continue;
+	current = count_ones(page_at(proc, i)->access_count);
     if(current < min_ones){
       min_index = i;
       min_ones = current;
     }
     else if(current == min_ones){
-		  if(proc->swapped_in[i].access_count < proc->swapped_in[min_index].access_count){
+		  if(page_at(proc, i)->access_count < page_at(proc, min_index)->access_count){
 			  min_index = i;
 		  }
 	  }
   }
   //cprintf("selected = %d", min_index);
-  return proc->swapped_in[min_index].virtual_address;
+  return page_at(proc, min_index)->virtual_address;
 }
 
 
 
+// Whether pg was used since the clock hand last passed it: its
+// accessed bit, or the one age_refs() took from it meanwhile.
+static int
+referenced(struct page* pg, pte_t* pte){
+  return (*pte & PTE_A) || (pg->flags & PAGE_REF);
+}
+
+// Clear both, as the clock hand passes pg.
+static void
+unreference(struct page* pg, pte_t* pte){
+  *pte = *pte & (~PTE_A);
+  pg->flags &= ~PAGE_REF;
+}
+
+// Victims are only picked from a full ring, so moving the hand
+// past an accessed page sends it to the tail.
 void*
 handle_SCFIFO(struct proc* proc){
-  void* virtual_address = (void*) -1;
-  
-  uint intena = 1;
-  while(intena)
+  for (;;)
   {
-    pte_t* pte = walkpgdir(proc->pgdir, (void*)PTE_ADDR(proc->swapped_in[0].virtual_address), 0);
-    if(*pte & PTE_A){
-      *pte = *pte & (~PTE_A);
-      struct page temp = proc->swapped_in[0];
-      shift_physical_addresses_left(1, proc);
-      proc->swapped_in[MAX_PHYS_PAGES - 1] = temp;
-    }
-    else{
-      virtual_address = proc->swapped_in[0].virtual_address;
-      shift_physical_addresses_left(1, proc);
-      proc->swapped_in[MAX_PHYS_PAGES - 1].virtual_address = virtual_address;
-      break;
-    }
+    struct page* pg = page_at(proc, proc->page_head);
+    pte_t* pte = walkpgdir(proc->pgdir, (void*)PTE_ADDR(pg->virtual_address), 0);
+    check_prefetch(pg, pte, proc);
+    if(!referenced(pg, pte) && !(pg->flags & PAGE_PINNED))
+      return pg->virtual_address;
+    unreference(pg, pte);
+    proc->page_head = ring_slot(1, proc);
   }
-  return virtual_address;
 }
 
 void*
 handle_AQ(struct proc* proc){
-	return proc->swapped_in[MAX_PHYS_PAGES - 1].virtual_address;
+  int pos = proc->swapped_in_count - 1;
+
+  while(page_at(proc, ring_slot(pos, proc))->flags & PAGE_PINNED)
+    pos--;
+	return page_at(proc, ring_slot(pos, proc))->virtual_address;
 }
 
+// Enhanced second chance. Sweep the clock from page_head for an
+// unreferenced page that can be dropped without a write, then for
+// any unreferenced page while clearing PTE_A, and repeat. The hand
+// stops at the victim, so swap_out() takes it from the head. A page
+// needs a write if written since it came in, or if it has no copy in
+// swap; an unwritten page of the executable is read again instead.
 void*
-find_page_to_swap(struct proc* proc){
+handle_NRU(struct proc* proc){
+  for (;;)
+  {
+    for (int pass = 0; pass < 2; ++pass)
+    {
+      for (int k = 0; k < proc->swapped_in_count; ++k)
+      {
+        int i = ring_slot(k, proc);
+        struct page* pg = page_at(proc, i);
+        pte_t* pte = walkpgdir(proc->pgdir, (void*)PTE_ADDR(pg->virtual_address), 0);
+        int dirty = (*pte & PTE_D) || (pg->slot == -1 && !(pg->flags & PAGE_FILE));
+
+        check_prefetch(pg, pte, proc);
+        if(!referenced(pg, pte) && !(pg->flags & PAGE_PINNED) && (pass == 1 || !dirty)){
+          proc->page_head = i;
+          return pg->virtual_address;
+        }
+        if(pass == 1)
+          unreference(pg, pte);
+      }
+    }
+  }
+}
+
+void
+reset_NFUA(struct page* pg, struct proc* proc){
+  pg->access_count = 0;
+}
+
+void
+reset_LAPA(struct page* pg, struct proc* proc){
+  pg->access_count = 0xFFFFFFFF;
+}
+
+void
+reset_none(struct page* pg, struct proc* proc){
+}
+
+// Remember va, just evicted from ARC list l, in ghost list l. Like
+// ARC, keep as many ghosts as the resident limit, dropping the
+// oldest. The lists are only a hint, so without memory for one va
+// is not remembered.
+static void
+add_ghost(void* va, int l, struct proc* proc){
+  int n = proc->max_phys_pages < NGHOST ? proc->max_phys_pages : NGHOST;
+  int drop;
+
+  if(proc->ghost[l] == 0 && (proc->ghost[l] = (void**)kalloc()) == 0)
+    return;
+  // More than one after the resident limit went down.
+  if((drop = proc->nghost[l] - (n - 1)) > 0){
+    proc->nghost[l] -= drop;
+    memmove(proc->ghost[l], proc->ghost[l] + drop, proc->nghost[l] * sizeof(void*));
+  }
+  proc->ghost[l][proc->nghost[l]++] = va;
+}
+
+// Remove va from ghost list l. Returns 0 if it is not there.
+static int
+remove_ghost(void* va, int l, struct proc* proc){
+  for (int i = 0; i < proc->nghost[l]; ++i)
+  {
+    if(proc->ghost[l][i] != va)
+      continue;
+    proc->nghost[l]--;
+    memmove(proc->ghost[l] + i, proc->ghost[l] + i + 1,
+            (proc->nghost[l] - i) * sizeof(void*));
+    return 1;
+  }
+  return 0;
+}
+
+// A page faulted in goes to T1, or to T2 if it is still remembered
+// in a ghost list. A hit in B1 means T1 was evicted from too early
+// and raises arc_target, a hit in B2 lowers it, by the ratio of the
+// ghost list sizes as in ARC.
+void
+reset_ARC(struct page* pg, struct proc* proc){
+  int b1 = proc->nghost[ARC_T1], b2 = proc->nghost[ARC_T2];
+
+  pg->access_count = ARC_T1;
+  if(pg->virtual_address == (void*) -1)
+    return;
+  if(remove_ghost(pg->virtual_address, ARC_T1, proc)){
+    proc->arc_target += b2 > b1 ? b2 / b1 : 1;
+    if(proc->arc_target > proc->max_phys_pages)
+      proc->arc_target = proc->max_phys_pages;
+  } else if(remove_ghost(pg->virtual_address, ARC_T2, proc)){
+    proc->arc_target -= b1 > b2 ? b1 / b2 : 1;
+    if(proc->arc_target < 0)
+      proc->arc_target = 0;
+  } else
+    return;
+  pg->access_count = ARC_T2;
+  proc->ghost_hits++;
+}
+
+// Adaptive replacement, after ARC as run on clocks (CAR). Pages are
+// in T1 when used once since they came in and in T2 when used since,
+// so that a scan passes through T1 without pushing out the pages in
+// T2. Evict from T1 while it holds at least arc_target pages, else
+// from T2: sweep from page_head past the other list, giving T1 pages
+// found accessed a move to T2 and T2 pages a second chance. Like
+// NRU, the hand stops at the victim. swap_out() remembers it in the
+// ghost list of its list once it is out.
+void*
+handle_ARC(struct proc* proc){
+  int t1 = 0, t2 = 0;
+
+  // Pinned pages are passed over, and not counted.
+  for (int k = 0; k < proc->swapped_in_count; ++k)
+  {
+    struct page* pg = page_at(proc, ring_slot(k, proc));
+    if(pg->flags & PAGE_PINNED)
+      continue;
+    if(pg->access_count == ARC_T1)
+      t1++;
+    else
+      t2++;
+  }
+  for (;;)
+  {
+    int from = ARC_T2;
+    if(t2 == 0 || (t1 > 0 && t1 >= proc->arc_target))
+      from = ARC_T1;
+    struct page* pg = page_at(proc, proc->page_head);
+    pte_t* pte = walkpgdir(proc->pgdir, (void*)PTE_ADDR(pg->virtual_address), 0);
+    check_prefetch(pg, pte, proc);
+    if(pg->access_count == from && !(pg->flags & PAGE_PINNED)){
+      if(!referenced(pg, pte))
+        return pg->virtual_address;
+      unreference(pg, pte);
+      if(from == ARC_T1){
+        pg->access_count = ARC_T2;
+        t1--;
+        t2++;
+      }
+    }
+    proc->page_head = ring_slot(1, proc);
+  }
+}
+
+// Shift the use history of the resident page pg of p, recording
+// whether it was accessed since the last call, and clear PTE_A.
+// Returns 1 if it was accessed. The working set is estimated from
+// the histories: the pages used in the last WSWINDOW agings.
+static int
+harvest_page(struct page* pg, struct proc* p){
+  pte_t* pte = walkpgdir(p->pgdir, (void*)PTE_ADDR(pg->virtual_address), 0);
+
+  check_prefetch(pg, pte, p);
+  pg->history >>= 1;
+  if(!(*pte & PTE_A))
+    return 0;
+  *pte = *pte & (~PTE_A);
+  pg->history |= 0x80000000;
+  pgtrace(p, pg->virtual_address, TR_REF);
+  return 1;
+}
+
+// Shift the aging counter of every resident page and record
+// whether it was accessed since the last call. The history for the
+// working set is kept apart, since policies reset access_count to
+// values of their own.
+void
+age_counters(struct proc* p){
+  uint recent = ~0U << (32 - WSWINDOW);
+  int wss = 0;
+
+  for (int i = 0; i < p->max_phys_pages; ++i)
+  {
+    struct page* pg = page_at(p, i);
+    if(pg->virtual_address == (void*) -1)
+      continue;
+	  pg->access_count >>= 1;
+    if(harvest_page(pg, p))
+	    pg->access_count |= (1 << ((sizeof(int) * 8) - 1));
+    if(pg->history & recent)
+      wss++;
+  }
+  p->wss = wss;
+}
+
+// The clock policies age no counters, but their pages are aged all
+// the same for the working set. A page found accessed is marked
+// PAGE_REF for the clock hand, see referenced().
+void
+age_refs(struct proc* p){
+  uint recent = ~0U << (32 - WSWINDOW);
+  int wss = 0;
+
+  for (int i = 0; i < p->max_phys_pages; ++i)
+  {
+    struct page* pg = page_at(p, i);
+    if(pg->virtual_address == (void*) -1)
+      continue;
+    if(harvest_page(pg, p))
+      pg->flags |= PAGE_REF;
+    if(pg->history & recent)
+      wss++;
+  }
+  p->wss = wss;
+}
+
+// Advance every accessed page one step towards the head of the queue.
+void
+age_AQ(struct proc* p){
+  for (int pos = 0; pos < p->swapped_in_count - 1; ++pos)
+  {
+    int i = ring_slot(pos, p);
+    int prev = ring_slot(pos + 1, p);
+    pte_t* current = walkpgdir(p->pgdir, (void*)PTE_ADDR(page_at(p, i)->virtual_address), 0);
+	  pte_t* prev_in_q = walkpgdir(p->pgdir, (void*)PTE_ADDR(page_at(p, prev)->virtual_address), 0);
+    if(!(*current & PTE_A) && (*prev_in_q & PTE_A))
+      swap_pages(i, prev, p);
+  }
+  age_counters(p);
+}
+
+// All replacement policies, indexed by the PG_* numbers in pgpolicy.h.
+struct pgpolicy pgpolicies[NPGPOLICY] = {
+[PG_NFUA]    { "NFUA",   handle_NFUA,   reset_NFUA, age_counters, 0 },
+[PG_LAPA]    { "LAPA",   handle_LAPA,   reset_LAPA, age_counters, 0 },
+[PG_SCFIFO]  { "SCFIFO", handle_SCFIFO, reset_none, age_refs,     1 },
+[PG_AQ]      { "AQ",     handle_AQ,     reset_none, age_AQ,       1 },
+[PG_NRU]     { "NRU",    handle_NRU,    reset_none, age_refs,     1 },
+[PG_ARC]     { "ARC",    handle_ARC,    reset_ARC,  age_refs,     1 },
+};
+
+// Policy given to new processes; SELECTION in the Makefile picks it.
+struct pgpolicy*
+default_policy(void){
 #ifdef NFUA
-    return handle_NFUA(proc);
+  return &pgpolicies[PG_NFUA];
 #elif LAPA
-    return handle_LAPA(proc);
-#elif SCFIFO
-    return handle_SCFIFO(proc);
+  return &pgpolicies[PG_LAPA];
 #elif AQ
-    return handle_AQ(proc);
-#endif 
-  return 0;
+  return &pgpolicies[PG_AQ];
+#elif NRU
+  return &pgpolicies[PG_NRU];
+#elif ARC
+  return &pgpolicies[PG_ARC];
+#else
+  return &pgpolicies[PG_SCFIFO];
+#endif
+}
+
+// Switch p to replacement policy number policy, resetting the
+// metadata of its resident pages. Returns the previous policy
+// number, or -1 if policy is not a valid policy number.
+int
+set_page_policy(struct proc* p, int policy){
+  int old;
+
+  if(policy <= 0 || policy >= NPGPOLICY || pgpolicies[policy].select == 0)
+    return -1;
+  old = p->policy - pgpolicies;
+  p->policy = &pgpolicies[policy];
+  for (int i = 0; p->page_hash && i < p->max_phys_pages; ++i){
+    page_at(p, i)->flags &= ~PAGE_REF;
+    p->policy->reset(page_at(p, i), p);
+  }
+  return old;
+}
+
+void*
+find_page_to_swap(struct proc* proc){
+  return proc->policy->select(proc);
 }
 
-void 
+static int
+zero_page(char *page)
+{
+  uint *p;
+
+  for(p = (uint*)page; p < (uint*)(page + PGSIZE); p++)
+    if(*p)
+      return 0;
+  return 1;
+}
+
+// Write the resident page at virtual_address to the swap file
+// and free its frame. Returns -1 if proc reached its swap limit.
+int
 swap_out(void* virtual_address, struct proc* proc) {
   pte_t* pte = walkpgdir(proc->pgdir, (void*)PTE_ADDR(virtual_address), 0);
   //cprintf("swap_out got %x as virtual_address\n", virtual_address);
@@ -599,71 +1385,248 @@ swap_out(void* virtual_address, struct proc* proc) {
   if (pte == 0) 
     panic("swap_out : null entry");
 
-  *pte &= (~PTE_P);
-  *pte |= (PTE_PG);
+  int physical_index = find_page_index((void*)PTE_ADDR(virtual_address), proc);
+  struct page* pg = page_at(proc, physical_index);
+  int page_index = pg->slot;
+  char* page_address = P2V(PTE_ADDR(*pte));
+
+  if((pg->flags & PAGE_FILE) && !(*pte & PTE_D)){
+    // Still as read from the executable; demand_page() reads it
+    // again on the next touch.
+    proc->clean_evictions++;
+    *pte = 0;
+    goto drop;
+  }
+  if(proc->swapped_out_count >= proc->max_swap_pages)
+    return -1;
 
-  int page_index = find_free_virtual_index(proc);
-  //cprintf("	swap_out got page index %d\n ", page_index);
-  if(page_index == -1)
-    panic("swap_out : file is full");
-  proc->swapped_out[page_index] = (void*)PTE_ADDR(virtual_address);
+  check_prefetch(pg, pte, proc);
+  if(page_index != -1 && !(*pte & PTE_D)){
+    // Unchanged since it was swapped in; the slot still has it.
+    proc->clean_evictions++;
+  }
+  else{
+    if(page_index != -1){
+      free_swap_slot(page_index);
+      pg->slot = -1;
+    }
+    if(zero_page(page_address)){
+      // Nothing to keep; swap_in gives it a zeroed frame.
+      page_index = ZERO_SLOT;
+      proc->clean_evictions++;
+      goto out;
+    }
+    page_index = alloc_swap_slot(proc);
+    //cprintf("	swap_out got page index %d\n ", page_index);
+    if(page_index == -1)
+      return -1;
+    // While this sleeps, global replacement may take other pages
+    // of proc and move this one in swapped_in, but leaves it be.
+    pg->flags |= PAGE_BUSY;
+    if(zswapstore(page_address, page_index) < 0)
+      swapwrite(page_address, page_index * PGSIZE, PGSIZE);
+    physical_index = find_page_index((void*)PTE_ADDR(virtual_address), proc);
+    page_at(proc, physical_index)->flags &= ~PAGE_BUSY;
+  }
+out:
   proc->total_swapped_out_count++;
   proc->swapped_out_count++;
-  
-  uint file_offset = page_index * PGSIZE ;
 
-  writeToSwapFile(proc, (char*)PTE_ADDR(P2V(*pte)), file_offset, PGSIZE);
+  // Keep the slot in the entry so swap_in can find the page.
+  *pte = SLOT_PTE(page_index) | (PTE_FLAGS(*pte) & ~PTE_P) | PTE_PG;
 
-  int physical_index = find_page_index((void*)PTE_ADDR(virtual_address), proc);
+drop:
   //cprintf("	swap_out physical_index index %d \n", physical_index);
-  proc->swapped_in[physical_index].virtual_address = (void*) -1;
-  proc->swapped_in_count--;
+  if(proc->policy == &pgpolicies[PG_ARC])
+    add_ghost((void*)PTE_ADDR(virtual_address),
+              page_at(proc, physical_index)->access_count, proc);
+  remove_page(physical_index, proc);
   
-  lcr3(V2P(proc->pgdir)); 
+  if(proc == myproc())
+    lcr3(V2P(proc->pgdir)); 
   
-  kfree((char*)PTE_ADDR(P2V(*pte)));
+  if((*pte & PTE_PG) && page_index != ZERO_SLOT)
+    cache_swap_frame(page_index, page_address);
+  else
+    kfree(page_address);
+  return 0;
 }
 
-int 
-swap_in(void* virtual_address, struct proc* proc) {
+// Write the resident page at virtual_address of proc, which is off
+// the CPUs, to a swap slot that it keeps, so that swap_out() can drop
+// it without a write while it stays clean. kswapd does this ahead
+// for the next victims. Returns -1 if there is no slot for it.
+int
+clean_page(void* virtual_address, struct proc* proc){
+  pte_t* pte = walkpgdir(proc->pgdir, (void*)PTE_ADDR(virtual_address), 0);
+  int i = find_page_index((void*)PTE_ADDR(virtual_address), proc);
+  struct page* pg;
+  char* mem;
+  int slot;
+
+  if(pte == 0 || !(*pte & PTE_P) || i == -1)
+    return 0;
+  pg = page_at(proc, i);
+  if(pg->flags & (PAGE_BUSY|PAGE_PINNED))
+    return 0;
+  if(!(*pte & PTE_D) && (pg->slot != -1 || (pg->flags & PAGE_FILE)))
+    return 0;  // clean already
+  mem = P2V(PTE_ADDR(*pte));
+  if(zero_page(mem))
+    return 0;  // swap_out() keeps no copy of it
+  if((slot = alloc_swap_slot(proc)) < 0)
+    return -1;
+  pg->flags |= PAGE_BUSY;
+  if(zswapstore(mem, slot) < 0)
+    swapwrite(mem, slot * PGSIZE, PGSIZE);
+  // Other pages may have moved in swapped_in meanwhile.
+  pg = page_at(proc, find_page_index((void*)PTE_ADDR(virtual_address), proc));
+  pg->flags &= ~(PAGE_BUSY|PAGE_FILE);
+  if(pg->slot != -1)
+    free_swap_slot(pg->slot);
+  pg->slot = slot;
+  *pte = *pte & (~PTE_D);
+  return 0;
+}
+
+// Bring the swapped out page at virtual_address back in. Returns
+// 0 if it is not swapped out or there is no room for it, 1 if it
+// was read and 2 if its frame was still in the swap cache.
+int
+swap_in_page(void* virtual_address, struct proc* proc) {
   pte_t* pte = walkpgdir(proc->pgdir, (char*)PTE_ADDR(virtual_address), 0);
 
   if (pte == 0) 
     panic("swap_in : entry is null");
 
   if(!(*pte & PTE_P) && (*pte & PTE_PG)){
-    *pte &= (~PTE_A);
-    int page_index = find_virtual_index((void*)PTE_ADDR(virtual_address),proc);
-    if(page_index == -1){
-      panic("swap_in : page not found");
-    }
-    
-    if(proc->swapped_in_count >= MAX_PHYS_PAGES){
-	  //cprintf("swap in\n");
-      swap_out(find_page_to_swap(proc), proc);
-    }
+    int page_index = PTE_SLOT(*pte);
 
-    char* page_address = kalloc();
-    if (readFromSwapFile(proc, page_address, page_index * PGSIZE, PGSIZE) == -1){
-      panic("swap_in : error while reading");
-	}
+    // Evict first, so that failing leaves the page swapped out;
+    // the swap partition may be full even after this slot is freed.
+    if(proc->swapped_in_count >= proc->max_phys_pages &&
+       grow_resident(proc) < 0 &&
+       swap_out(find_page_to_swap(proc), proc) < 0)
+      return 0;
+
+    char* page_address = 0;
+    if(page_index != ZERO_SLOT)
+      page_address = take_swap_frame(page_index);
+    int r = page_address ? 2 : 1;
+    if(page_address == 0){
+      reserve_frames();
+      if((page_address = kalloc()) == 0)
+        return 0;
+      if(page_index == ZERO_SLOT)
+        memset(page_address, 0, PGSIZE);
+      else if(zswapload(page_address, page_index) < 0)
+        swapread(page_address, page_index * PGSIZE, PGSIZE);
+    }
 
-    mappages(proc->pgdir, (char*)PTE_ADDR(virtual_address), PGSIZE, V2P(page_address), PTE_W | PTE_U);
+    // Clean until written, since it matches the slot, which the
+    // page keeps so that evicting it again needs no write.
+    *pte = V2P(page_address) | (PTE_FLAGS(*pte) & ~(PTE_PG | PTE_A | PTE_D)) | PTE_P;
+    if(krefcount(page_address) > 1){
+      // A cached frame another process still maps copy-on-write.
+      if(*pte & PTE_W)
+        *pte = (*pte & ~PTE_W) | PTE_COW;
+    } else if(*pte & PTE_COW)
+      *pte = (*pte & ~PTE_COW) | PTE_W;
 	
-    proc->swapped_out[page_index] = 0;
 	proc->swapped_out_count--;
-	
-    int physical_index = find_free_physical_index(proc);
-    update_page(virtual_address, physical_index, proc);
-	proc->swapped_in_count++;
 
-    return 1;
+    if(insert_page(virtual_address, proc) < 0)
+      panic("swap_in : no room");
+    if(page_index != ZERO_SLOT)
+      page_at(proc, find_page_index(virtual_address, proc))->slot = page_index;
+
+    return r;
   }
 
   return 0;
 }
 
+// Once two faults in a row were the same number of pages apart,
+// swap in the next pages along that stride before they fault: at
+// most READAHEAD pages, and a quarter of the resident limit. At the
+// limit each one evicts a victim of the policy, which passes over
+// the faulting page and the pages prefetched with it, pinned until
+// the readahead is done.
+void
+swap_readahead(void* virtual_address, struct proc* proc){
+  int stride = ((int)virtual_address - (int)proc->last_fault) / PGSIZE;
+  void* held[READAHEAD + 1];
+  int i, nheld = 0;
+
+  proc->last_fault = virtual_address;
+  if(stride == 0 || stride != proc->fault_stride){
+    proc->fault_stride = stride;
+    return;
+  }
+  if((i = find_page_index(virtual_address, proc)) == -1)
+    return;
+  if(!(page_at(proc, i)->flags & PAGE_PINNED)){
+    page_at(proc, i)->flags |= PAGE_PINNED;
+    held[nheld++] = virtual_address;
+  }
+  for (int k = 1; k <= READAHEAD; ++k)
+  {
+    // Leave a page to evict, and the frames reclaim keeps free.
+    if(k > proc->max_phys_pages / 4 ||
+       proc->npinned + nheld >= proc->max_phys_pages ||
+       current_free_pages <= MINFREE)
+      break;
+    char* a = (char*)virtual_address + k * stride * PGSIZE;
+    if((uint)a >= proc->sz)
+      break;
+    pte_t* pte = walkpgdir(proc->pgdir, a, 0);
+    if(pte == 0 || (*pte & (PTE_P|PTE_PG)) != PTE_PG)
+      continue;
+    if(!swap_in_page(a, proc))
+      break;
+    page_at(proc, find_page_index(a, proc))->flags |= PAGE_PREFETCHED|PAGE_PINNED;
+    held[nheld++] = a;
+    proc->prefetch_count++;
+    // So that the next fault along the stride continues it.
+    proc->last_fault = a;
+  }
+  while(nheld > 0)
+    if((i = find_page_index(held[--nheld], proc)) != -1)
+      page_at(proc, i)->flags &= ~PAGE_PINNED;
+}
+
+// Handle a page fault on the swapped out page at virtual_address.
+// Returns 0 if it is not swapped out or there is no room for it.
+int
+swap_in(void* virtual_address, struct proc* proc) {
+  int r = swap_in_page(virtual_address, proc);
+
+  if(r == 0)
+    return 0;
+  if(r == 2)
+    proc->minor_faults++;
+  else{
+    proc->major_faults++;
+    majorfaults++;
+  }
+  swap_readahead((void*)PTE_ADDR(virtual_address), proc);
+  return 1;
+}
+
+// Count a hit for a prefetched page the first time it is found
+// accessed, before its PTE_A bit is cleared or dropped.
 void
+check_prefetch(struct page* pg, pte_t* pte, struct proc* proc){
+  if((pg->flags & PAGE_PREFETCHED) && (*pte & PTE_A)){
+    pg->flags &= ~PAGE_PREFETCHED;
+    proc->prefetch_hits++;
+  }
+}
+
+// Add the mapped page at virtual_address to the resident pages of
+// proc, first swapping out a victim if proc is at its resident limit
+// and cannot grow it. Returns -1 if that swap out failed.
+int
 insert_page(void* virtual_address, struct proc* proc){
   pte_t* pte = walkpgdir(proc->pgdir, (char*)virtual_address, 0);
   
@@ -671,53 +1634,217 @@ insert_page(void* virtual_address, struct proc* proc){
     panic("insert_page");
   }
   *pte &= (~PTE_A);
-  if(proc->swapped_in_count >= MAX_PHYS_PAGES){
+  if(proc->swapped_in_count >= proc->max_phys_pages && grow_resident(proc) < 0){
 	//cprintf("insert_page before call to swap out \n");
-    swap_out(find_page_to_swap(proc), proc);
+    if(swap_out(find_page_to_swap(proc), proc) < 0)
+      return -1;
 	//cprintf("insert_page after to swap out \n");
   }
-  //cprintf("insert_page before call to find_free_physical_index \n");
   int physical_index = find_free_physical_index(proc);
-  //cprintf("insert_page after call to find_free_physical_index\n ");
-  //cprintf("insert_page before call to update_page\n ");
   update_page(virtual_address, physical_index, proc);
-  //cprintf("insert_page after call to update_page\n ");
   proc->swapped_in_count++;
+  return 0;
 }
 
 void
 update_page(void *virtual_address, int physical_index, struct proc* proc){
-  proc->swapped_in[physical_index].virtual_address = (void*)(PTE_ADDR(virtual_address));
-  #ifdef NFUA
-  proc->swapped_in[physical_index].access_count = 0;
-  #elif LAPA
-  proc->swapped_in[physical_index].access_count = 0xFFFFFFFF;
-  #endif
+  struct page* pg = page_at(proc, physical_index);
+
+  pg->virtual_address = (void*)(PTE_ADDR(virtual_address));
+  pg->flags = 0;
+  pg->slot = -1;
+  pg->history = 0;
+  proc->policy->reset(pg, proc);
+  hash_page(physical_index, proc);
+  set_rmap(proc, pg->virtual_address);
 }
 
+// Reverse map from each physical frame to the resident page that
+// got it last. Entries are not cleared when pages go, so users check
+// them against the page table. A frame shared after fork maps back
+// to only one of its pages.
+struct rmap {
+  struct proc* proc;
+  void* virtual_address;
+} rmap[PHYSTOP / PGSIZE];
+int rmap_hand;  // frame the global clock looks at next
+
 void
-update_process_pages_access(struct proc* p){
-  #ifdef AQ
-  for (int i = 0; i < MAX_PHYS_PAGES - 1 ; ++i)
+set_rmap(struct proc* proc, void* virtual_address){
+  pte_t* pte = walkpgdir(proc->pgdir, virtual_address, 0);
+  struct rmap* r = &rmap[PTE_ADDR(*pte) / PGSIZE];
+
+  r->proc = proc;
+  r->virtual_address = (void*)PTE_ADDR(virtual_address);
+}
+
+// Pick a page to free a frame from, with a clock over all user
+// frames: an accessed page has PTE_A cleared and gets a second
+// chance. Pages a system call pinned, and pages of processes on
+// other CPUs or frozen by another reclaim_frame(), are passed over:
+// a process asleep in piperead() uses its buffer under the pipe lock
+// once it wakes. Returns the owner of the page, or 0 if none
+// was found. The caller holds ptable.lock.
+struct proc*
+pick_global_victim(void** virtual_address){
+  struct proc* cur = myproc();
+  struct proc* victim = 0;
+  int flush = 0;
+
+  for (int n = 0; n < 2 * NELEM(rmap) && victim == 0; ++n)
   {
-    pte_t* current = walkpgdir(p->pgdir, (void*)PTE_ADDR(p->swapped_in[i].virtual_address), 0);
-	  pte_t* prev_in_q = walkpgdir(p->pgdir, (void*)PTE_ADDR(p->swapped_in[i+1].virtual_address), 0);
-    if(!(*current & PTE_A) && (*prev_in_q & PTE_A)){
-      struct page temp = p->swapped_in[i+1];
-      p->swapped_in[i+1] = p->swapped_in[i];
-      p->swapped_in[i] = temp;
+    struct rmap* r = &rmap[rmap_hand];
+    struct proc* p = r->proc;
+    rmap_hand = (rmap_hand + 1) % NELEM(rmap);
+    if(p == 0 || p->page_hash == 0 || p->pgfrozen)
+      continue;
+    if(p != cur && p->state != SLEEPING && p->state != RUNNABLE)
+      continue;
+    pte_t* pte = walkpgdir(p->pgdir, r->virtual_address, 0);
+    if(pte == 0 || !(*pte & PTE_P) || PTE_ADDR(*pte) != (r - rmap) * PGSIZE)
+      continue;
+    int i = find_page_index(r->virtual_address, p);
+    if(i == -1 || (page_at(p, i)->flags & (PAGE_BUSY|PAGE_PINNED)))
+      continue;
+    check_prefetch(page_at(p, i), pte, p);
+    if(referenced(page_at(p, i), pte)){
+      unreference(page_at(p, i), pte);
+      flush |= (p == cur);
+      continue;
     }
+    *virtual_address = r->virtual_address;
+    victim = p;
   }
-  #endif
-  #ifndef SCFIFO
-  for (int i = 0; i < MAX_PHYS_PAGES; ++i)
-  {
-    pte_t* pte = walkpgdir(p->pgdir, (void*)PTE_ADDR(p->swapped_in[i].virtual_address), 0);
-	  p->swapped_in[i].access_count >>= 1;
-    if(*pte & PTE_A){
-      *pte = *pte & (~PTE_A);
-	    p->swapped_in[i].access_count |= (1 << ((sizeof(int) * 8) - 1));
+  if(flush)
+    lcr3(V2P(cur->pgdir));
+  return victim;
+}
+
+// With global replacement, double the resident limit of proc, up to
+// MAX_RSS_PAGES, instead of swapping out one of its own pages; frames
+// come back through reserve_frames(). Returns -1 if it cannot grow.
+int
+grow_resident(struct proc* proc){
+#if GLOBAL
+  int n = proc->max_phys_pages * 2;
+
+  if(n > MAX_RSS_PAGES)
+    n = MAX_RSS_PAGES;
+  if(n == proc->max_phys_pages || grow_pages_metadata(n, proc) < 0)
+    return -1;
+  linearize_pages(proc);
+  proc->max_phys_pages = n;
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+// Keep MINFREE frames free, called before allocating user pages:
+// with global replacement by paging out the coldest pages of any
+// process, else by freeing cached frames.
+void
+reserve_frames(void){
+  for (int n = 0; n < MINFREE && current_free_pages < MINFREE; ++n)
+#if GLOBAL
+    if(reclaim_frame() < 0)
+#else
+    if(shrink_swap_cache() < 0 && pcacheshrink() < 0)
+#endif
+      break;
+}
+
+// Set the resident and swap page limits of proc; a limit <= 0 is
+// left unchanged. Lowering the resident limit swaps pages out.
+// Below PFFMIN pages, an instruction can need more pages than fit,
+// and fault forever. Returns -1 if a limit is out of range or
+// cannot be met.
+int
+set_page_limits(struct proc* proc, int phys, int swap){
+  if(proc->page_hash == 0)  // not paged, see allocproc
+    return -1;
+  if((phys > 0 && phys < PFFMIN) || phys > MAX_RSS_PAGES || swap > MAX_SWAP_PAGES)
+    return -1;
+  if(swap > 0){
+    if(swap < proc->swapped_out_count)
+      return -1;
+    proc->max_swap_pages = swap;
+  }
+  if(phys <= 0)
+    return 0;
+  if(grow_pages_metadata(phys, proc) < 0)
+    return -1;
+  // The policies pick victims among a full ring, so shrink it to
+  // the resident pages while swapping out.
+  linearize_pages(proc);
+  while(proc->swapped_in_count > phys){
+    proc->max_phys_pages = proc->swapped_in_count;
+    if(swap_out(find_page_to_swap(proc), proc) < 0)
+      return -1;
+    linearize_pages(proc);
+  }
+  proc->max_phys_pages = phys;
+  return 0;
+}
+
+// Page fault frequency control: grow the resident limit of p by
+// the faults of the last PFF_TICKS ticks it ran while there were
+// more than PFFHIGH of them and free frames last, and shrink it by
+// an eighth while there were at most PFFLOW, down to PFFMIN.
+static void
+adjust_resident(struct proc* p){
+  int faults = p->page_faults_count - p->pff_faults;
+  int n = p->max_phys_pages;
+
+  p->pff_faults = p->page_faults_count;
+  if(faults > PFFHIGH && current_free_pages >= LOWFREE)
+    n += faults;
+  else if(faults <= PFFLOW)
+    n -= n / 8 ? n / 8 : 1;
+  if(n > MAX_RSS_PAGES)
+    n = MAX_RSS_PAGES;
+  if(n < PFFMIN)
+    n = PFFMIN;
+  if(n != p->max_phys_pages)
+    set_page_limits(p, n, 0);
+}
+
+// Page out every resident page of p that global replacement is not
+// paging out already and no system call pinned, for load control.
+// Returns the number of pages paged out.
+int
+swap_out_all(struct proc* p){
+  struct page* pg;
+  int i = 0, n = 0;
+
+  while(i < p->swapped_in_count){
+    pg = page_at(p, ring_slot(i, p));
+    if(pg->flags & (PAGE_BUSY|PAGE_PINNED)){
+      i++;
+      continue;
     }
+    // Position i now holds another page, or is past the end.
+    if(swap_out(pg->virtual_address, p) < 0)
+      break;
+    n++;
   }
-  #endif
-}
\ No newline at end of file
+  return n;
+}
+
+// Called on each timer tick that interrupts p in user mode. Adjusts
+// the resident limit of p every PFF_TICKS if that is set, and every
+// AGE_TICKS ages its pages and estimates its working set.
+void
+update_process_pages_access(struct proc* p){
+  if(p->pid <= 2)
+    return;
+  if(PFF_TICKS && ++p->pff_ticks >= PFF_TICKS){
+    p->pff_ticks = 0;
+    adjust_resident(p);
+  }
+  if(++p->age_ticks < AGE_TICKS)
+    return;
+  p->age_ticks = 0;
+  p->policy->age(p);
+  lcr3(V2P(p->pgdir));  // so the cleared PTE_A bits get set again
+}
@@ -0,0 +1,264 @@
+// Compressed swap cache.
+//
+// swap_out() offers each page it writes to the swap partition to
+// this cache first, which keeps it compressed in a pool of at most
+// ZSWAP frames, and swap_in() looks here before reading the disk.
+// A page is kept by its swap slot and stays until the slot is
+// freed, or until the pool needs room for newer pages and writes it
+// back to its slot on disk.
+//
+// Pages are compressed by runs of 32-bit words: zero words, copies
+// of one word, and literal words, which covers the zero filled
+// heap and stack and the padded data that make up most of a user
+// process. Pages that do not compress to ZMAXCHUNKS go to disk.
+//
+// The pool is divided into chunks of ZCHUNK bytes, and a page takes
+// contiguous chunks of one frame.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+
+#define ZCHUNK      256
+#define ZMAXCHUNKS  12                // of PGSIZE/ZCHUNK in a frame
+#define NWORDS      (PGSIZE / 4)
+
+// Each run starts with a tag byte that has n-1 in the low six bits.
+#define ZZERO       0x00              // n zero words
+#define ZREP        0x40              // n copies of the word that follows
+#define ZLIT        0x80              // the n words that follow
+#define ZRUN        64                // longest run
+
+struct zent {
+  char *data;       // the compressed page, 0 if the slot has none
+  ushort frame;
+  uchar chunk;      // first chunk in frame
+  uchar nchunk;
+  uchar writeback;  // being written to the swap partition
+  uint stored;      // zswap.clock when stored
+};
+
+struct {
+  struct spinlock lock;
+  char *frame[ZSWAP];
+  ushort used[ZSWAP];     // a bit for each chunk in use
+  struct zent ent[MAX_SWAP_PAGES];
+  uint clock;
+} zswap;
+
+void
+zswapinit(void)
+{
+  initlock(&zswap.lock, "zswap");
+}
+
+// Compress the page at src into dst, or only measure it if dst is
+// 0. Returns the compressed length.
+static uint
+zencode(uint *src, uchar *dst)
+{
+  uint i, n, len;
+
+  len = 0;
+  for(i = 0; i < NWORDS; i += n){
+    if(src[i] == 0){
+      for(n = 1; i+n < NWORDS && n < ZRUN && src[i+n] == 0; n++)
+        ;
+      if(dst)
+        dst[len] = ZZERO | (n-1);
+      len += 1;
+    } else if(i+1 < NWORDS && src[i+1] == src[i]){
+      for(n = 2; i+n < NWORDS && n < ZRUN && src[i+n] == src[i]; n++)
+        ;
+      if(dst){
+        dst[len] = ZREP | (n-1);
+        memmove(dst+len+1, &src[i], 4);
+      }
+      len += 1 + 4;
+    } else {
+      for(n = 1; i+n < NWORDS && n < ZRUN && src[i+n] != 0; n++)
+        if(i+n+1 < NWORDS && src[i+n+1] == src[i+n])
+          break;
+      if(dst){
+        dst[len] = ZLIT | (n-1);
+        memmove(dst+len+1, &src[i], 4*n);
+      }
+      len += 1 + 4*n;
+    }
+  }
+  return len;
+}
+
+static void
+zdecode(uchar *src, uint *dst)
+{
+  uint i, j, n, w;
+
+  for(i = 0; i < NWORDS; i += n){
+    n = (*src & (ZRUN-1)) + 1;
+    switch(*src++ & ~(ZRUN-1)){
+    case ZZERO:
+      memset(&dst[i], 0, 4*n);
+      break;
+    case ZREP:
+      memmove(&w, src, 4);
+      src += 4;
+      for(j = 0; j < n; j++)
+        dst[i+j] = w;
+      break;
+    default:
+      memmove(&dst[i], src, 4*n);
+      src += 4*n;
+      break;
+    }
+  }
+}
+
+// Find n free contiguous chunks for e, adding a frame to the pool
+// if there is room. Returns 0 if there are none.
+static char*
+zalloc(struct zent *e, int n)
+{
+  int f, c;
+  ushort mask;
+
+  for(f = 0; f < ZSWAP; f++){
+    if(zswap.frame[f] == 0)
+      continue;
+    for(c = 0; c + n <= PGSIZE/ZCHUNK; c++){
+      mask = ((1 << n) - 1) << c;
+      if((zswap.used[f] & mask) == 0)
+        goto found;
+    }
+  }
+  for(f = 0; f < ZSWAP; f++)
+    if(zswap.frame[f] == 0)
+      break;
+  if(f == ZSWAP || (zswap.frame[f] = kalloc()) == 0)
+    return 0;
+  c = 0;
+  mask = (1 << n) - 1;
+
+found:
+  zswap.used[f] |= mask;
+  e->frame = f;
+  e->chunk = c;
+  e->nchunk = n;
+  e->data = zswap.frame[f] + c*ZCHUNK;
+  return e->data;
+}
+
+static void
+zfree(struct zent *e)
+{
+  zswap.used[e->frame] &= ~(((1 << e->nchunk) - 1) << e->chunk);
+  if(zswap.used[e->frame] == 0){
+    kfree(zswap.frame[e->frame]);
+    zswap.frame[e->frame] = 0;
+  }
+  e->data = 0;
+}
+
+// Write the oldest page in the pool to its slot on disk and free
+// its chunks. Called and returns with zswap.lock held, but
+// releases it while writing. Returns -1 if there is nothing to
+// write back.
+static int
+zwriteback(void)
+{
+  struct zent *e, *old;
+  char *buf;
+  int slot;
+
+  old = 0;
+  for(e = zswap.ent; e < &zswap.ent[MAX_SWAP_PAGES]; e++)
+    if(e->data && !e->writeback && (old == 0 || e->stored < old->stored))
+      old = e;
+  if(old == 0 || (buf = kalloc()) == 0)
+    return -1;
+  slot = old - zswap.ent;
+  // Hold the slot so that it is not reused before the write is
+  // done; its other users see the page as still here till then.
+  dup_swap_slot(slot);
+  old->writeback = 1;
+  zdecode((uchar*)old->data, (uint*)buf);
+  release(&zswap.lock);
+
+  swapwrite(buf, slot * PGSIZE, PGSIZE);
+  kfree(buf);
+
+  acquire(&zswap.lock);
+  zfree(old);
+  old->writeback = 0;
+  release(&zswap.lock);
+  free_swap_slot(slot);
+  acquire(&zswap.lock);
+  return 0;
+}
+
+// Keep the page at src for swap slot slot. Returns -1 if it does
+// not compress well or the pool is full, and the caller must write
+// it to disk.
+int
+zswapstore(char *src, int slot)
+{
+  struct zent *e = &zswap.ent[slot];
+  uint len;
+  int n;
+
+  if(ZSWAP == 0)
+    return -1;
+  len = zencode((uint*)src, 0);
+  n = (len + ZCHUNK - 1) / ZCHUNK;
+  if(n > ZMAXCHUNKS)
+    return -1;
+
+  acquire(&zswap.lock);
+  if(e->data)
+    panic("zswapstore");
+  while(zalloc(e, n) == 0){
+    if(zwriteback() < 0){
+      release(&zswap.lock);
+      return -1;
+    }
+  }
+  zencode((uint*)src, (uchar*)e->data);
+  e->stored = ++zswap.clock;
+  release(&zswap.lock);
+  return 0;
+}
+
+// Read the page of swap slot slot into dst. Returns -1 if it is
+// not in the pool, and the caller must read it from disk.
+int
+zswapload(char *dst, int slot)
+{
+  struct zent *e = &zswap.ent[slot];
+
+  acquire(&zswap.lock);
+  if(e->data == 0){
+    release(&zswap.lock);
+    return -1;
+  }
+  zdecode((uchar*)e->data, (uint*)dst);
+  release(&zswap.lock);
+  return 0;
+}
+
+// Forget the page of swap slot slot, whose last user is freeing
+// it. A page being written back is freed when the write is done.
+void
+zswapdrop(int slot)
+{
+  struct zent *e = &zswap.ent[slot];
+
+  if(ZSWAP == 0)
+    return;
+  acquire(&zswap.lock);
+  if(e->data && !e->writeback)
+    zfree(e);
+  release(&zswap.lock);
+}